@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK Node Lib.
+ */
+#include <stdbool.h>
+#include "mgos.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_anim.h"
+#include "nvk_clock.h"
+
+#ifndef NVK_INCLUDE_EFFECT_ANIM_H_
+#define NVK_INCLUDE_EFFECT_ANIM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Opens the configured animation, returns its frame period or 0 */
+int anim_effect_start() {
+    const char *file = mgos_sys_config_get_effects_anim_file();
+    if (!nvk_anim_open(file)) {
+        return 0;
+    }
+    return nvk_anim_header()->frame_ms;
+}
+
+static int32_t s_anim_effect_frame = 0;
+
+/* Streams the next frame, a finished animation without loop holds the last one.
+ * With a synced clock the player seeks to the frame the shared time asks for */
+void anim_effect(void *args) {
+    (void) args;
+    const struct nvk_anim_header *h = nvk_anim_header();
+    if (h != NULL && nvk_clock_synced()) {
+        int32_t f = nvk_clock_frame(&s_anim_effect_frame, h->frame_ms);
+        if (h->flags & NVK_ANIM_FLAG_LOOP) {
+            f %= h->frames;
+        } else if (f >= h->frames - 1) {
+            if (nvk_anim_frame() == h->frames) {
+                return; // The last frame is already on the strip
+            }
+            f = h->frames - 1;
+        }
+        if (f != nvk_anim_frame() && !nvk_anim_seek(f)) {
+            return;
+        }
+    }
+    if (nvk_anim_next_frame()) {
+        node_neopixel_show();
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_EFFECT_ANIM_H_ */
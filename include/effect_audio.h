@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK Node Lib.
+ */
+#include <stdbool.h>
+#include "mgos.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_fixed.h"
+#include "nvk_audio.h"
+
+#ifndef NVK_INCLUDE_EFFECT_AUDIO_H_
+#define NVK_INCLUDE_EFFECT_AUDIO_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_EFFECT_FRAME_MS 20
+
+static struct audio_frame s_audio_effect_frame;
+static int s_audio_beat_level = 0;
+static const rgb_color s_audio_band_colors[NVK_AUDIO_BANDS] = {
+    { 0xFF, 0x00, 0x00 }, { 0xFF, 0x60, 0x00 }, { 0xFF, 0xC0, 0x00 }, { 0x80, 0xFF, 0x00 },
+    { 0x00, 0xFF, 0x40 }, { 0x00, 0xC0, 0xFF }, { 0x00, 0x40, 0xFF }, { 0x80, 0x00, 0xFF }
+};
+
+/* Strip filled from the start proportionally to the loudness, green to red */
+void audio_vu_effect(void *args) {
+    (void) args;
+    if (!audio_process(&s_audio_effect_frame)) {
+        return;
+    }
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    int lit = s_audio_effect_frame.level * num_pixels / 255; // Exact, a full level lights every pixel
+    q16_16 step = fixed_q16_ratio(255, num_pixels);
+    for (int p = 0; p < num_pixels; p++) {
+        if (p < lit) {
+            int r = fixed_q16_int(p * step);
+            node_neopixel_set(p, r, 255 - r, 0);
+        } else {
+            node_neopixel_set(p, 0, 0, 0);
+        }
+    }
+    node_neopixel_show();
+}
+
+/* One segment per band, brightness follows the band energy */
+void audio_spectrum_effect(void *args) {
+    (void) args;
+    if (!audio_process(&s_audio_effect_frame)) {
+        return;
+    }
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    q16_16 step = fixed_q16_ratio(NVK_AUDIO_BANDS, num_pixels);
+    for (int p = 0; p < num_pixels; p++) {
+        int b = fixed_q16_int(p * step);
+        uint8_t v = s_audio_effect_frame.bands[b];
+        rgb_color c = s_audio_band_colors[b];
+        node_neopixel_set(p, fixed_scale8(c.red, v), fixed_scale8(c.green, v), fixed_scale8(c.blue, v));
+    }
+    node_neopixel_show();
+}
+
+/* Full strip flash in the strip colour on every beat, fading out between beats */
+void audio_beat_effect(void *args) {
+    neopixel_effect_data *user_beat_data = (neopixel_effect_data*) args;
+    if (!audio_process(&s_audio_effect_frame)) {
+        return;
+    }
+    if (s_audio_effect_frame.beat) {
+        s_audio_beat_level = 256;
+    } else {
+        s_audio_beat_level -= s_audio_beat_level >> 2;
+    }
+    rgb_color c = get_rgb_color(user_beat_data->color);
+    c.red = (c.red * s_audio_beat_level) >> 8;
+    c.green = (c.green * s_audio_beat_level) >> 8;
+    c.blue = (c.blue * s_audio_beat_level) >> 8;
+    node_neopixel_set_all_pixels(c);
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_EFFECT_AUDIO_H_ */
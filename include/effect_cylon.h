@@ -21,6 +21,8 @@
 #include <stdbool.h>
 #include "mgos.h"
 #include "nvk_nodes_neopixel.h"
+#include "nvk_fixed.h"
+#include "nvk_palette.h"
 
 #ifndef NVK_INCLUDE_EFFECT_CYLON_H_
 #define NVK_INCLUDE_EFFECT_CYLON_H_
@@ -35,12 +37,15 @@ static int s_cylon_effect_counter = 0;
 void cylon_effect(void *args) {
     int eye_size = mgos_sys_config_get_effects_cylon_size();
     neopixel_effect_data *user_cylon_data = (neopixel_effect_data*) args;
-    rgb_color c = get_rgb_color(user_cylon_data->color);
-    int r = c.red / 10;
-    int g = c.green / 10;
-    int b = c.blue / 10;
     int p = s_cylon_effect_counter;
     int n = mgos_sys_config_get_nodes_neopixel_pixels();
+    rgb_color c = get_rgb_color(user_cylon_data->color);
+    if (nvk_palette_strip() && n > 0) {
+        c = nvk_palette_color(NVK_PALETTE_STRIP, (uint8_t) (p * 256 / n));
+    }
+    int r = fixed_scale8(c.red, FIXED_FRAC8(1, 10));
+    int g = fixed_scale8(c.green, FIXED_FRAC8(1, 10));
+    int b = fixed_scale8(c.blue, FIXED_FRAC8(1, 10));
     
     if(s_cylon_effect_dir) {
         s_cylon_effect_counter++;
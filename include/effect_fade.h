@@ -29,28 +29,18 @@
 extern "C" {
 #endif
 
-static int s_fade_effect_counter = 0;
-static int s_fade_effect_iteration = 0;
-static bool s_fade_effect_dir = true;
+#define FADE_EFFECT_PERIOD 1530 // Three colours up and down
 
+static int32_t s_fade_effect_counter = 0;
+
+/* Frame f of the cycle: colour f / 510 ramps up over 255 frames and back down */
 void fade_effect(void *args) {
     (void) args;
-    if(s_fade_effect_counter >= 3) {
-        s_fade_effect_counter = 0;
-      }
-
-    if(s_fade_effect_dir) {
-        s_fade_effect_dir = s_fade_effect_iteration < 254;
-        s_fade_effect_iteration++;
-    } else {
-        s_fade_effect_dir = s_fade_effect_iteration < 2;
-        s_fade_effect_iteration--;
-        if(s_fade_effect_dir) {
-        s_fade_effect_counter++;
-        }
-    }
-    int color = s_fade_effect_iteration & 255;
-    switch(s_fade_effect_counter) {
+    int f = s_fade_effect_counter % FADE_EFFECT_PERIOD;
+    s_fade_effect_counter = f + 1;
+    int t = f % 510;
+    int color = t < 255 ? t + 1 : 509 - t;
+    switch(f / 510) {
         case 0:
         color = color << 16;
         break;
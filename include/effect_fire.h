@@ -21,6 +21,7 @@
 #include <stdbool.h>
 #include "mgos.h"
 #include "nvk_nodes_neopixel.h"
+#include "nvk_palette.h"
 
 #ifndef NVK_INCLUDE_EFFECT_FIRE_H_
 #define NVK_INCLUDE_EFFECT_FIRE_H_
@@ -38,8 +39,9 @@ void fire_effect(void *args) {
     int cooling = mgos_sys_config_get_effects_fire_cooling();
     int sparking = mgos_sys_config_get_effects_fire_sparking();
 
+    int cooldown_max = ((cooling * 10) / num_pixels) + 2;
     for(int i = 0; i < num_pixels; i++) {
-        cooldown = (int) mgos_rand_range(0, ((cooling * 10) / num_pixels) + 2);
+        cooldown = (int) mgos_rand_range(0, cooldown_max);
         if(cooldown > heat[i]) {
             heat[i] = 0;
         } else {
@@ -57,18 +59,10 @@ void fire_effect(void *args) {
     }
 
     node_neopixel_clear();
+    const uint8_t *lut = nvk_palette_lut(NVK_PALETTE_HEAT);
     for(int j = 0; j < num_pixels; j++) {
-        int t192 = round((heat[j] / 255.0) * 191);
-        int heatramp = t192 & 0x3F;
-        heatramp <<= 0x02;
-        heatramp = heatramp & 0xFF;
-        if(t192 > 0x80) {
-            node_neopixel_set(j, 0xFF, 0xFF, heatramp);
-        } else if(t192 > 0x40) {
-            node_neopixel_set(j, 0xFF, heatramp, 0x00);
-        } else {
-            node_neopixel_set(j, heatramp, 0x00, 0x00);
-        }
+        const uint8_t *c = lut + (heat[j] > 0xFF ? 0xFF : heat[j]) * 3;
+        node_neopixel_set(j, c[0], c[1], c[2]);
     }
 
     node_neopixel_show();
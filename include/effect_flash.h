@@ -29,7 +29,7 @@
 extern "C" {
 #endif
 
-static int s_flash_effect_counter = 0;
+static int32_t s_flash_effect_counter = 0;
 static rgb_color s_flash_effect_colors[] = {
     { 0x00, 0xFF, 0x00 }, { 0x00, 0x00, 0xFF }, { 0xFF, 0x00, 0x00 },
     { 0xFF, 0x7F, 0x00 }, { 0x50, 0x30, 0x50 }, { 0x4D, 0x4D, 0xFF },
@@ -39,15 +39,13 @@ static rgb_color s_flash_effect_colors[] = {
     { 0xDE, 0x94, 0xFA }, { 0x9F, 0x9F, 0x5F }, { 0x6F, 0x43, 0x43 }
 };
 
-static int s_flash_effect_colors_size = sizeof(s_flash_effect_colors) / sizeof(rgb_color);
+#define FLASH_EFFECT_PERIOD (sizeof(s_flash_effect_colors) / sizeof(rgb_color))
 
 void flash_effect(void *args) {
     (void) args;
-    if(s_flash_effect_counter >= s_flash_effect_colors_size)
-    {
-        s_flash_effect_counter = 0;
-    }
-    node_neopixel_set_all_pixels(s_flash_effect_colors[s_flash_effect_counter++]);
+    int f = s_flash_effect_counter % (int) FLASH_EFFECT_PERIOD;
+    s_flash_effect_counter = f + 1;
+    node_neopixel_set_all_pixels(s_flash_effect_colors[f]);
 }
 
 #ifdef __cplusplus
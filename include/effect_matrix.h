@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK Node Lib.
+ */
+#include <stdbool.h>
+#include "mgos.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_matrix.h"
+#include "nvk_palette.h"
+
+#ifndef NVK_INCLUDE_EFFECT_MATRIX_H_
+#define NVK_INCLUDE_EFFECT_MATRIX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MATRIX_RAIN_DROPS 8 // One new drop per this many columns and frame, on average
+
+/*
+ * Drops in the strip colour fall down the panel leaving a fading trail.
+ * The picture moves one row per frame, the top row is the trail of the
+ * row below dimmed to 3/4 or a new drop. Needs a matrix layout.
+ */
+void matrix_rain_effect(void *args) {
+    neopixel_effect_data *data = (neopixel_effect_data *) args;
+    int width = nvk_matrix_width();
+    if (width == 0) {
+        return;
+    }
+    rgb_color black = { 0, 0, 0 };
+    rgb_color drop = get_rgb_color(data->color);
+    nvk_matrix_scroll(0, 1, black);
+    for (int x = 0; x < width; x++) {
+        rgb_color c = black;
+        int below = nvk_matrix_xy(x, 1);
+        if (below >= 0) {
+            c = node_neopixel_get_pixel_color(below);
+            c.red = (c.red * 3) >> 2;
+            c.green = (c.green * 3) >> 2;
+            c.blue = (c.blue * 3) >> 2;
+        }
+        if ((int) mgos_rand_range(0, MATRIX_RAIN_DROPS) == 0) {
+            c = nvk_palette_strip() ? nvk_palette_color(NVK_PALETTE_STRIP, (uint8_t) (x * 256 / width)) : drop;
+        }
+        nvk_matrix_fill(x, 0, 1, 1, c);
+    }
+    node_neopixel_show();
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_EFFECT_MATRIX_H_ */
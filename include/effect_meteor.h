@@ -21,6 +21,8 @@
 #include <stdbool.h>
 #include "mgos.h"
 #include "nvk_nodes_neopixel.h"
+#include "nvk_particles.h"
+#include "nvk_palette.h"
 
 #ifndef NVK_INCLUDE_EFFECT_METEOR_H_
 #define NVK_INCLUDE_EFFECT_METEOR_H_
@@ -31,38 +33,33 @@ extern "C" {
 
 static int s_meteor_effect_counter = 0;
 
-void fade_to_black(int pixel, int fade) {
-    rgb_color color = node_neopixel_get_pixel_color(pixel);
-    color.red = (color.red <= 10) ? 0 : (int)(color.red - (color.red * fade / 256));
-    color.green = (color.green <= 10) ? 0 : (int)(color.green - (color.green * fade / 256));
-    color.blue = (color.blue <= 10) ? 0 : (int)(color.blue - (color.blue * fade / 256));
-    node_neopixel_set(pixel, color.red, color.green, color.blue);
-}
-
+/* The head leaves one particle per frame that holds for the meteor size and then fades as trail */
 void meteor_effect() { 
     int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
     int meteor_size = mgos_sys_config_get_effects_meteor_size();
     bool random_decay = mgos_sys_config_get_effects_meteor_random();
     int trail_decay = mgos_sys_config_get_effects_meteor_trail();
     int color = mgos_sys_config_get_strip_color();
-    rgb_color rgb = get_rgb_color(color);
 
     if (s_meteor_effect_counter == 0) {
-        node_neopixel_turn_off();
+        particles_reset();
     }
 
-    for(int j = 0; j < num_pixels; j++) {
-        if(!random_decay || (int) mgos_rand_range(0, 9) > 4) {
-            fade_to_black(j, trail_decay);
+    particles_update(num_pixels);
+    if (s_meteor_effect_counter < num_pixels) {
+        int decay = trail_decay;
+        if (random_decay) {
+            decay = (int) mgos_rand_range(trail_decay / 2, trail_decay);
         }
-    }
-    for(int j = 0; j < meteor_size; j++) {
-        int p = s_meteor_effect_counter - j;
-        if((p < num_pixels) && (p >= 0)) {
-            node_neopixel_set(p, rgb.red, rgb.green, rgb.blue);
+        if (nvk_palette_strip()) {
+            rgb_color c = nvk_palette_color(NVK_PALETTE_STRIP, (uint8_t) (s_meteor_effect_counter * 256 / num_pixels));
+            color = get_hex_color(c.red, c.green, c.blue);
         }
+        particles_spawn(s_meteor_effect_counter << 8, 0, color, meteor_size - 1, decay);
     }
 
+    node_neopixel_clear();
+    particles_render(num_pixels);
     node_neopixel_show();
     
     if (++s_meteor_effect_counter >= num_pixels * 2) {
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK Node Lib.
+ */
+#include <stdbool.h>
+#include "mgos.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_fxvm.h"
+#include "nvk_clock.h"
+
+#ifndef NVK_INCLUDE_EFFECT_PROGRAM_H_
+#define NVK_INCLUDE_EFFECT_PROGRAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static int32_t s_program_effect_frame = 0;
+
+/* Runs the active user program, see nvk_fxvm.h */
+void program_effect(void *args) {
+    (void) args;
+    struct fxvm_program *prog = fxvm_active();
+    if (prog == NULL) {
+        return;
+    }
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    int32_t t = nvk_clock_frame(&s_program_effect_frame, mgos_sys_config_get_strip_speed() / 10);
+    fxvm_render(prog, num_pixels, t);
+    node_neopixel_show();
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_EFFECT_PROGRAM_H_ */
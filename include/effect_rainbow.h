@@ -21,6 +21,9 @@
 #include <stdbool.h>
 #include "mgos.h"
 #include "nvk_nodes_neopixel.h"
+#include "nvk_clock.h"
+#include "nvk_palette.h"
+#include "nvk_fixed.h"
 
 #ifndef NVK_INCLUDE_EFFECT_RAINBOW_H_
 #define NVK_INCLUDE_EFFECT_RAINBOW_H_
@@ -29,53 +32,43 @@
 extern "C" {
 #endif
 
-static int s_rainbow_effect_counter = 0;
-static int s_rainbow_cycle_effect_counter = 0;
+#define RAINBOW_EFFECT_PERIOD 257 // 256 frames and the call that wraps the counter
+#define RAINBOW_CYCLE_EFFECT_PERIOD (256 * 5 + 1)
 
-static int wheel(int p) {
-  p = 255 - p;
-  if (p < 85) {
-    return get_hex_color((255 - p * 3), 0, (p * 3));
+static int32_t s_rainbow_effect_counter = 0;
+static int32_t s_rainbow_cycle_effect_counter = 0;
+
+static void rainbow_tile(int first, int count, rgb_color *out, void *arg) {
+  int i = *(int *) arg;
+  for(int p = 0; p < count; p++) {
+    out[p] = nvk_palette_color(NVK_PALETTE_RAINBOW, (first + p + i) & 255);
   }
-  if (p < 170) {
-    p = p - 85;
-    return get_hex_color(0, (p * 3), (255 - p * 3));
+}
+
+static void rainbow_cycle_tile(int first, int count, rgb_color *out, void *arg) {
+  int i = *(int *) arg;
+  q16_16 step = fixed_q16_ratio(256, mgos_sys_config_get_nodes_neopixel_pixels());
+  for(int p = 0; p < count; p++) {
+    int k = fixed_q16_int((first + p) * step);
+    out[p] = nvk_palette_color(NVK_PALETTE_RAINBOW, (k + i) & 255);
   }
-  p = p - 170;
-  return get_hex_color((p * 3), (255 - p * 3), 0);
 }
 
+/* Frames come from the shared clock when the fleet is synced */
 void rainbow_effect(void *args) {
     (void) args;
-    if(s_rainbow_effect_counter < 256) {
-    int i = s_rainbow_effect_counter++;
-    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
-    node_neopixel_clear();
-    for(int p = 0; p < num_pixels; p++) {
-      int color = wheel((p + i) & 255);
-      rgb_color c = get_rgb_color(color);
-      node_neopixel_set(p, c.red, c.green, c.blue);
-    }
-    node_neopixel_show();
-  } else {
-    s_rainbow_effect_counter = 0;
+    int speed = mgos_sys_config_get_strip_speed();
+    int i = nvk_clock_frame(&s_rainbow_effect_counter, speed) % RAINBOW_EFFECT_PERIOD;
+    if(i < 256) {
+    node_neopixel_stream(rainbow_tile, &i);
   }
 }
 
 void rainbow_cycle_effect() {
-  if(s_rainbow_cycle_effect_counter < 256 * 5) {
-    int i = s_rainbow_cycle_effect_counter++;
-    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
-    node_neopixel_clear();
-    for(int p = 0; p < num_pixels; p++) {
-      int k = p * 256 / num_pixels;
-      int color = wheel((k + i) & 255);
-      rgb_color c = get_rgb_color(color);
-      node_neopixel_set(p, c.red, c.green, c.blue);
-    }
-    node_neopixel_show();
-  } else {
-    s_rainbow_cycle_effect_counter = 0;
+  int speed = mgos_sys_config_get_strip_speed();
+  int i = nvk_clock_frame(&s_rainbow_cycle_effect_counter, speed) % RAINBOW_CYCLE_EFFECT_PERIOD;
+  if(i < 256 * 5) {
+    node_neopixel_stream(rainbow_cycle_tile, &i);
   }
 }
 
@@ -29,31 +29,17 @@
 extern "C" {
 #endif
 
-static int s_rgb_loop_effect_counter = 0;
-static int s_rbg_loop_effect_iteration = 0;
-static bool s_rgb_loop_effect_dir = true;
+#define RGB_LOOP_EFFECT_PERIOD 2040 // Four colours held for a ramp up and down each
 
+static int32_t s_rgb_loop_effect_counter = 0;
+
+/* Frame f of the cycle: colour f / 510, red, green, blue and red again */
 void rbg_loop_effect(void *args) {
     (void) args;
-    if (s_rbg_loop_effect_iteration > 3) {
-        s_rbg_loop_effect_iteration = 0;
-    }
-
-    uint8_t k = s_rgb_loop_effect_counter & 255;
-    if (s_rgb_loop_effect_dir)
-    {
-        s_rgb_loop_effect_dir = k < 254;
-        s_rgb_loop_effect_counter++;
-    } else {
-        s_rgb_loop_effect_dir = k < 2;
-        s_rgb_loop_effect_counter--;
-        if(s_rgb_loop_effect_dir)
-        {
-        s_rbg_loop_effect_iteration++;
-        }
-    }
+    int f = s_rgb_loop_effect_counter % RGB_LOOP_EFFECT_PERIOD;
+    s_rgb_loop_effect_counter = f + 1;
     int color = 0xFF0000;
-    switch(s_rbg_loop_effect_iteration)
+    switch(f / 510)
     {
         case 1:
         color = color >> 8;
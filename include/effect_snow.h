@@ -21,6 +21,7 @@
 #include <stdbool.h>
 #include "mgos.h"
 #include "nvk_nodes_neopixel.h"
+#include "nvk_fixed.h"
 
 #ifndef NVK_INCLUDE_EFFECT_SNOW_H_
 #define NVK_INCLUDE_EFFECT_SNOW_H_
@@ -29,25 +30,89 @@
 extern "C" {
 #endif
 
-#define SNOW_EFFECT_INDEX 11
-#define MODE_EFFECT 2
+#define SNOW_MAX_FLAKES 16
+#define SNOW_BASE_LEVEL 0x10
 
-static void snow_effect_cb() {
-  rgb_color c = get_rgb_color(0x101010);
-  node_neopixel_set_all_pixels(c);
+struct snow_flake {
+    int pixel; // -1 if free
+    int level; // Sparkle above the base colour (0 - 255)
+    int decay; // Level lost per frame
+};
+
+static struct snow_flake s_snow_flakes[SNOW_MAX_FLAKES];
+
+static void snow_set_level(int pixel, int level) {
+    int v = fixed_lerp8(SNOW_BASE_LEVEL, 255, level);
+    node_neopixel_set(pixel, v, v, v);
+}
+
+static bool snow_pixel_is_busy(int pixel) {
+    for (int i = 0; i < SNOW_MAX_FLAKES; i++) {
+        if (s_snow_flakes[i].pixel == pixel) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool snow_spawn_flake(int num_pixels) {
+    int p = (int) mgos_rand_range(0, num_pixels - 1);
+    if (snow_pixel_is_busy(p)) {
+        return false;
+    }
+    for (int i = 0; i < SNOW_MAX_FLAKES; i++) {
+        struct snow_flake *f = &s_snow_flakes[i];
+        if (f->pixel < 0) {
+            f->pixel = p;
+            f->level = 255;
+            f->decay = 255 / (int) mgos_rand_range(2, 12);
+            snow_set_level(p, f->level);
+            return true;
+        }
+    }
+    return false;
 }
 
-void snow_effect() {
-    if(mgos_sys_config_get_strip_effect() == SNOW_EFFECT_INDEX && mgos_sys_config_get_app_mode() == MODE_EFFECT) {
-        rgb_color c = get_rgb_color(0x101010);
-        node_neopixel_set_all_pixels(c);
-        int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
-        int p = (int) mgos_rand_range(0, num_pixels - 1);
-        node_neopixel_set(p, 0xFF, 0xFF, 0xFF);
+/* Paint the base colour once, frames only touch the flakes */
+void snow_effect_start() {
+    for (int i = 0; i < SNOW_MAX_FLAKES; i++) {
+        s_snow_flakes[i].pixel = -1;
+    }
+    node_neopixel_set_all_pixels(get_rgb_color(SNOW_BASE_LEVEL * 0x010101));
+}
+
+void snow_effect(void *args) {
+    (void) args;
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    int frame = mgos_sys_config_get_strip_speed() / 10;
+    bool dirty = false;
+
+    for (int i = 0; i < SNOW_MAX_FLAKES; i++) {
+        struct snow_flake *f = &s_snow_flakes[i];
+        if (f->pixel < 0) {
+            continue;
+        }
+        f->level -= f->decay;
+        if (f->level <= 0) {
+            snow_set_level(f->pixel, 0);
+            f->pixel = -1;
+        } else {
+            snow_set_level(f->pixel, f->level);
+        }
+        dirty = true;
+    }
+
+    // About one new flake every 560 ms per 30 pixels, as the old random 120 - 1000 ms delay
+    int budget = frame * num_pixels;
+    for (; budget > 0; budget -= 30 * 560) {
+        if (budget < 30 * 560 && (int) mgos_rand_range(0, 30 * 560) >= budget) {
+            break;
+        }
+        dirty |= snow_spawn_flake(num_pixels);
+    }
+
+    if (dirty) {
         node_neopixel_show();
-        mgos_set_timer(20, false, snow_effect_cb, NULL);
-        int d = (int) mgos_rand_range(120, 1000);
-        mgos_set_timer(d, false, snow_effect, NULL);
     }
 }
 
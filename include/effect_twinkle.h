@@ -21,6 +21,8 @@
 #include <stdbool.h>
 #include "mgos.h"
 #include "nvk_nodes_neopixel.h"
+#include "nvk_particles.h"
+#include "nvk_palette.h"
 
 #ifndef NVK_INCLUDE_EFFECT_TWINKLE_H_
 #define NVK_INCLUDE_EFFECT_TWINKLE_H_
@@ -29,41 +31,29 @@
 extern "C" {
 #endif
 
-static int s_twinkle_effect_counter = 0;
-static int s_twinkle_random_effect_counter = 0;
+static const struct particle_emitter s_twinkle_emitter = {
+    .rate = 256, .position = NVK_PARTICLES_RANDOM, .velocity = 0,
+    .color = NVK_PARTICLES_RANDOM, .hold_min = 2, .hold_max = 10, .decay = 64
+};
 
-void twinkle_effect(void *args) {
-    neopixel_effect_data *user_twinkle_data = (neopixel_effect_data*) args;
-    rgb_color c = get_rgb_color(user_twinkle_data->color);
+static void twinkle_frame(const struct particle_emitter *e) {
     int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    particles_update(num_pixels);
+    particles_emit(e, num_pixels);
+    node_neopixel_clear();
+    particles_render(num_pixels);
+    node_neopixel_show();
+}
 
-    if (s_twinkle_effect_counter < num_pixels / 3) {
-        int p = (int) mgos_rand_range(0, num_pixels - 1);
-        node_neopixel_set(p, c.red, c.green, c.blue);
-        node_neopixel_show();
-        s_twinkle_effect_counter++;
-    } else {
-        s_twinkle_effect_counter = 0;
-        node_neopixel_turn_off();
-    }
-
+void twinkle_effect(void *args) {
+    neopixel_effect_data *user_twinkle_data = (neopixel_effect_data*) args;
+    struct particle_emitter e = s_twinkle_emitter;
+    e.color = nvk_palette_strip() ? NVK_PARTICLES_PALETTE : user_twinkle_data->color;
+    twinkle_frame(&e);
 }
 
 void twinkle_random_effect() {
-  int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
-
-  if (s_twinkle_random_effect_counter < num_pixels / 3) {
-    int p = (int) mgos_rand_range(0, num_pixels - 1);
-    int r = (int) mgos_rand_range(0, 254);
-    int g = (int) mgos_rand_range(0, 254);
-    int b = (int) mgos_rand_range(0, 254);
-    node_neopixel_set(p, r, g, b);
-    node_neopixel_show();
-    s_twinkle_random_effect_counter++;
-  } else {
-    s_twinkle_random_effect_counter = 0;
-    node_neopixel_turn_off();
-  }
+    twinkle_frame(&s_twinkle_emitter);
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK animation player. Pre-rendered animations are streamed from a file on
+ * the device filesystem (upload with FS.Put) through a small read buffer,
+ * one frame per call, the file is never loaded whole.
+ *
+ * File layout, little endian:
+ *   header   "NVKA", u8 version (1), u8 flags (bit 0 loop), u16 pixels,
+ *            u16 frames, u16 frame ms, u16 keyframes, u16 reserved
+ *   index    keyframes x { u32 frame, u32 file offset of that frame }
+ *   frames   u8 type ('K' keyframe, 'D' delta) then opcodes until END
+ * Opcodes are one byte, top two bits the kind and low six bits length - 1:
+ *   00 SKIP n pixels unchanged from the previous frame
+ *   01 RUN n pixels of the r, g, b that follows
+ *   10 LITERAL n pixels, n x r, g, b follow
+ *   11 END of frame
+ * A keyframe does not SKIP, so it decodes without the previous frame. The
+ * first frame must be a keyframe and be listed in the index.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mgos_rpc.h"
+
+#ifndef NVK_INCLUDE_NVK_ANIM_H_
+#define NVK_INCLUDE_NVK_ANIM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_ANIM_VERSION 1
+#define NVK_ANIM_FLAG_LOOP 0x01
+#define NVK_ANIM_READ_BUFFER 64
+
+struct nvk_anim_header {
+    uint8_t version;
+    uint8_t flags;
+    uint16_t pixels;
+    uint16_t frames;
+    uint16_t frame_ms;
+    uint16_t keyframes;
+};
+
+bool nvk_anim_open(const char *path);
+void nvk_anim_close();
+/* Null when no animation is open */
+const struct nvk_anim_header *nvk_anim_header();
+/* Decodes the next frame into the framebuffer, false at the end or on error */
+bool nvk_anim_next_frame();
+/* Positions the player so the next decoded frame is the given one */
+bool nvk_anim_seek(int frame);
+int nvk_anim_frame();
+void nvk_anim_rpc_seek_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_ANIM_H_ */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK audio analysis. Reads a block of samples from a pluggable source, runs a
+ * 64 point fixed-point FFT and reduces it to a level, band energies and beats.
+ * The ADC source is sampled by a hardware timer into a ring buffer between
+ * audio_start() and audio_stop(), a block is the newest 64 samples.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef NVK_INCLUDE_NVK_AUDIO_H_
+#define NVK_INCLUDE_NVK_AUDIO_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_AUDIO_FRAME 64
+#define NVK_AUDIO_BANDS 8
+
+/* Fills buf with n signed Q15 samples, returns how many were read */
+typedef int (*audio_read_t)(int16_t *buf, int n, void *ctx);
+
+struct audio_source {
+    audio_read_t read;
+    void *ctx;
+};
+
+struct audio_frame {
+    uint8_t level; // Overall loudness (0 - 255)
+    uint8_t bands[NVK_AUDIO_BANDS]; // Band energy, low to high (0 - 255)
+    bool beat; // Low band well above its recent average
+    uint32_t time_us; // Time spent reading and analysing the block
+};
+
+/* Starts sampling the ADC, false if effects.audio is not usable */
+bool audio_start();
+void audio_stop();
+/* Replace the sample source, NULL restores the ADC source */
+void audio_set_source(const struct audio_source *source);
+/* Read and analyse one block, returns false if the source had no samples */
+bool audio_process(struct audio_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_AUDIO_H_ */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK fleet clock. One leader publishes its uptime on app.clock.topic,
+ * followers track offset and drift against it, and effects take their
+ * frame index from the shared time so strips in a room stay in phase.
+ *
+ * Messages are stamped when the leader sends them and there is no round
+ * trip, so a follower's offset takes in the mean one-way latency through
+ * the broker: followers run that much (a few ms on a LAN) behind the
+ * leader. Followers of the same broker share most of it and stay closer
+ * to each other than to the leader; Driver.Clock offset_us includes it.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mgos_rpc.h"
+
+#ifndef NVK_INCLUDE_NVK_CLOCK_H_
+#define NVK_INCLUDE_NVK_CLOCK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* True on the leader, or on a follower with a recent leader sample */
+bool nvk_clock_synced();
+/* Shared time, the local uptime when not synced */
+int64_t nvk_clock_now_ms();
+/* Frame of an effect ticking every period_ms. Synced devices compute it from
+ * the shared time, otherwise the local counter is advanced and returned */
+int32_t nvk_clock_frame(int32_t *counter, int period_ms);
+bool nvk_clock_init();
+void nvk_clock_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_CLOCK_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK frame cache. Effects that are a pure function of a frame counter
+ * declare their period, the first cycle is recorded compressed from the
+ * framebuffer within effects.cache.budget bytes and played back after that.
+ * Playback advances the effect's counter as rendering would, so a suspended
+ * effect saves the frame it is really at. A change of effect, strip colour,
+ * speed, length or palettes records it again.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef NVK_INCLUDE_NVK_FCACHE_H_
+#define NVK_INCLUDE_NVK_FCACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Timer argument for fcache_effect */
+struct fcache_effect {
+    void (*render)(void *arg); // Renders and shows one frame
+    void *arg;
+    int period; // Calls before the output repeats
+    int32_t *counter; // Frame counter render advances by one per call
+};
+
+/* Timer callback, plays cached frames or renders and records a new one */
+void fcache_effect(void *arg);
+/* Drop the cache, next fcache_effect records again */
+void fcache_reset();
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_FCACHE_H_ */
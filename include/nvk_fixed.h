@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK fixed point helpers for effect inner loops. The ESP8266 has no FPU
+ * and no integer divider, so per-pixel work stays in shifts, multiplies
+ * and table reads:
+ *   q16_16  16.16 fixed point, e.g. per-pixel steps of a frame
+ *   scale8  v * s / 256 with 255 as the identity
+ *   div255  exact x / 255 for 0 <= x < 65535, any product of two bytes
+ *   qadd8   add clamped to 255
+ *   lerp8   a to b in 256 steps, rounded
+ *   sin8    one turn in 256 steps, 128 +- 127
+ * test/test_fixed.c checks them on the host against the exact maths.
+ */
+
+#include <stdint.h>
+#include "mgos_rpc.h"
+
+#ifndef NVK_INCLUDE_NVK_FIXED_H_
+#define NVK_INCLUDE_NVK_FIXED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int32_t q16_16;
+
+#define FIXED_Q16(n) ((q16_16) ((n) << 16))
+/* Constant n / d as a scale8 factor, folded at compile time */
+#define FIXED_FRAC8(n, d) ((uint8_t) ((n) * 256 / (d)))
+
+/* One division per frame, then every pixel steps by the result. Rounded up so
+ * fixed_q16_int(p * ratio) is exactly p * n / d for 0 <= p < d, n > 0, p * d < 65536 */
+static inline q16_16 fixed_q16_ratio(int32_t n, int32_t d) {
+    return d > 0 ? (q16_16) ((((int64_t) n << 16) + d - 1) / d) : 0;
+}
+
+static inline q16_16 fixed_q16_mul(q16_16 a, q16_16 b) {
+    return (q16_16) (((int64_t) a * b) >> 16);
+}
+
+static inline int32_t fixed_q16_int(q16_16 a) {
+    return a >> 16;
+}
+
+static inline uint8_t fixed_scale8(uint8_t v, uint8_t s) {
+    return (uint8_t) ((v * (s + 1)) >> 8);
+}
+
+static inline uint32_t fixed_div255(uint32_t x) {
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+static inline uint8_t fixed_qadd8(int a, int b) {
+    int v = a + b;
+    return (uint8_t) (v > 255 ? 255 : v);
+}
+
+/* a + (b - a) * t / 255 rounded to the nearest */
+static inline uint8_t fixed_lerp8(uint8_t a, uint8_t b, uint8_t t) {
+    return b >= a ? (uint8_t) (a + fixed_div255((b - a) * t + 127))
+                  : (uint8_t) (a - fixed_div255((a - b) * t + 127));
+}
+
+/* 127 * sin(2 * pi * i / 256) for the first quarter turn */
+static const uint8_t FIXED_SIN8_QUARTER[65] = {
+    0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46, 49, 51, 54, 57, 60, 63,
+    65, 68, 71, 73, 76, 78, 81, 83, 85, 88, 90, 92, 94, 96, 98, 100, 102, 104, 106, 107,
+    109, 111, 112, 113, 115, 116, 117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126,
+    126, 126, 127, 127, 127, 127
+};
+
+static inline uint8_t fixed_sin8(uint8_t theta) {
+    uint8_t i = theta & 0x3F;
+    uint8_t v = FIXED_SIN8_QUARTER[theta & 0x40 ? 64 - i : i];
+    return theta & 0x80 ? 128 - v : 128 + v;
+}
+
+void fixed_rpc_bench_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_FIXED_H_ */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK effect VM. Per pixel programs are compiled on the device to register
+ * bytecode and run once per pixel and frame.
+ *
+ * A program is one expression (used as hue) or three separated by ';'
+ * (red, green, blue). Integer operators: + - * / % & | ^ << >> < > and unary -.
+ * Variables: i (pixel), n (pixels), t (frame), a b c d (parameters).
+ * Functions: sin(x) tri(x) abs(x) rnd(x) min(x, y) max(x, y), sin and tri map
+ * 0 - 255 to one period in 0 - 255.
+ * Example: "sin(i * 16 + t * 4); 0; 255 - sin(i * 16 + t * 4)"
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mgos_rpc.h"
+
+#ifndef NVK_INCLUDE_NVK_FXVM_H_
+#define NVK_INCLUDE_NVK_FXVM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FXVM_MAX_CODE 96
+#define FXVM_REGS 16
+#define FXVM_PARAMS 4
+
+struct fxvm_insn {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+};
+
+struct fxvm_program {
+    struct fxvm_insn code[FXVM_MAX_CODE];
+    int len;
+    int outputs; // 1 (hue) or 3 (rgb), result of output k is in register k
+    int32_t params[FXVM_PARAMS];
+};
+
+/* Returns 0 on success or the 1-based source position of the error */
+int fxvm_compile(const char *src, struct fxvm_program *prog, const char **error);
+/* Run the program for every pixel of frame t straight into the framebuffer */
+void fxvm_render(const struct fxvm_program *prog, int num_pixels, int32_t t);
+/* Compile the program stored in effects.program.file into the active slot */
+bool fxvm_load();
+struct fxvm_program *fxvm_active();
+void fxvm_rpc_upload_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+void fxvm_rpc_bench_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_FXVM_H_ */
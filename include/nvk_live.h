@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK live state. A snapshot of the driver state kept up to date by its
+ * sources, with a version bumped on every change so pollers can ask for
+ * it only when something moved. Open dashboards connect a WebSocket to
+ * /live, get the whole state once and then only the fields that changed,
+ * merged over app.live.coalesce ms into a single frame. Fields that move
+ * every frame (power) are also held to one change a second.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef NVK_INCLUDE_NVK_LIVE_H_
+#define NVK_INCLUDE_NVK_LIVE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_LIVE_MAX_CLIENTS 4
+
+enum nvk_live_field {
+    NVK_LIVE_MODE = 0,
+    NVK_LIVE_EFFECT,
+    NVK_LIVE_COLOR,
+    NVK_LIVE_TEMP,
+    NVK_LIVE_HUMD,
+    NVK_LIVE_LUM,
+    NVK_LIVE_PIR,
+    NVK_LIVE_BRIGHTNESS,
+    NVK_LIVE_MOTION, // Uptime (s) of the last accepted motion
+    NVK_LIVE_POWER, // Estimated strip current (mA) after limiting
+    NVK_LIVE_POWER_LIMIT, // Brightness kept by the power governor (%)
+    NVK_LIVE_DHT_VALID, // 1 while temp and humd come from a fresh sample
+    NVK_LIVE_FIELDS
+};
+
+/* Cheap when nothing changed, a change schedules one coalesced push */
+void nvk_live_set(enum nvk_live_field field, int value);
+int nvk_live_get(enum nvk_live_field field);
+/* Starts at 1 and grows with every change of any field */
+uint32_t nvk_live_version();
+bool nvk_live_init();
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_LIVE_H_ */
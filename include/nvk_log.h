@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK deferred format log. Records are stored as (id, time, args) in a RAM
+ * ring and only turned into text when drained.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mgos_rpc.h"
+
+#ifndef NVK_INCLUDE_NVK_LOG_H_
+#define NVK_INCLUDE_NVK_LOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_LOG_RING_SIZE 64
+
+enum nvk_log_module {
+    NVK_LOG_DRIVER = 0,
+    NVK_LOG_PIR = 1,
+    NVK_LOG_DHT = 2,
+    NVK_LOG_PHOTORESISTOR = 3,
+    NVK_LOG_NEOPIXEL = 4,
+    NVK_LOG_MODULES = 5
+};
+
+/*
+ * Message catalog, formats take up to three %d arguments. Named messages
+ * take a %s first, the name of their first argument looked up when the
+ * record is formatted, then the %d arguments.
+ */
+#define NVK_LOG_MESSAGES(X) \
+    X(NVK_LOG_MSG_MOTION, false, "Motion detected") \
+    X(NVK_LOG_MSG_EFFECT_START, true, "Starting %s effect (%d)") \
+    X(NVK_LOG_MSG_LUMINOSITY, false, "Luminosity: %d lux") \
+    X(NVK_LOG_MSG_DHT_SAMPLE, false, "Temperature: %d*C Humidity: %d%%") \
+    X(NVK_LOG_MSG_DHT_READ_ERROR, false, "Failed to read data from sensor (%d)") \
+    X(NVK_LOG_MSG_PIR_TOGGLE, false, "PIR: %d")
+
+#define NVK_LOG_MSG_ENUM(id, named, fmt) id,
+enum nvk_log_msg {
+    NVK_LOG_MESSAGES(NVK_LOG_MSG_ENUM)
+    NVK_LOG_MSG_COUNT
+};
+#undef NVK_LOG_MSG_ENUM
+
+extern int8_t g_nvk_log_levels[NVK_LOG_MODULES];
+
+typedef const char *(*nvk_log_name_fn)(int32_t value);
+
+void nvk_log_write(enum nvk_log_module module, int level, enum nvk_log_msg msg, int32_t a0, int32_t a1, int32_t a2);
+
+#define NVK_LOG3(module, level, msg, a0, a1, a2)                      \
+    do {                                                              \
+        if ((level) <= g_nvk_log_levels[module]) {                    \
+            nvk_log_write(module, level, msg, a0, a1, a2);            \
+        }                                                             \
+    } while (0)
+#define NVK_LOG2(module, level, msg, a0, a1) NVK_LOG3(module, level, msg, a0, a1, 0)
+#define NVK_LOG1(module, level, msg, a0) NVK_LOG3(module, level, msg, a0, 0, 0)
+#define NVK_LOG0(module, level, msg) NVK_LOG3(module, level, msg, 0, 0, 0)
+
+/* Format pending records to the UART log, returns how many were written */
+int nvk_log_flush();
+bool nvk_log_set_level(const char *module, int level);
+/* Names the first argument of a named message, "?" until one is set */
+void nvk_log_set_name_lookup(enum nvk_log_msg msg, nvk_log_name_fn lookup);
+bool nvk_log_init();
+void nvk_log_rpc_drain_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+void nvk_log_rpc_level_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_LOG_H_ */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK matrix layout. Maps logical (x, y) of a panel made of strips to the
+ * physical pixel through a table built once at init, so 2-D kernels walk
+ * a row of the table instead of doing coordinate math per pixel.
+ * nodes.neopixel.matrix.layout is one of:
+ *   serpentine  rows alternate direction, the usual wiring of panels
+ *   zigzag      every row starts at the same side
+ *   custom      {"map": [p0, p1, ...]} from nodes.neopixel.matrix.file,
+ *               width x height physical indices row by row, -1 for holes
+ * (0, 0) is the first pixel of the strip. A width of 0 keeps the strip a
+ * line and the kernels do nothing.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "nvk_nodes_neopixel.h"
+
+#ifndef NVK_INCLUDE_NVK_MATRIX_H_
+#define NVK_INCLUDE_NVK_MATRIX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_MATRIX_NONE 0xFFFF // Table entry of a hole
+
+int nvk_matrix_width();
+int nvk_matrix_height();
+/* Physical pixel of (x, y), -1 outside the panel or on a hole */
+int nvk_matrix_xy(int x, int y);
+/* Kernels clip to the panel and only write the buffer, show when done */
+void nvk_matrix_fill(int x, int y, int w, int h, rgb_color c);
+/* src holds w x h colours row by row */
+void nvk_matrix_blit(int x, int y, int w, int h, const rgb_color *src);
+/* Moves the picture by (dx, dy), uncovered pixels get fill */
+void nvk_matrix_scroll(int dx, int dy, rgb_color fill);
+bool nvk_matrix_init();
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_MATRIX_H_ */
@@ -44,6 +44,33 @@ typedef void (*node_on_range_handler_t)(struct node_range_values *values, void *
 
 typedef void (*node_switch_handler_t)(int value, void *user_data);
 
+#define NODE_RANGE_UNKNOWN -1
+#define NODE_RANGE_ON 0
+
+/*
+ * Edge triggered range watcher. Handlers fire only when the value moves to
+ * another state (on range, above or below), once it has held that state for
+ * `dwell` ms and at most once every `interval` ms. A value outside a bound has
+ * to come back `hysteresis` units inside it before it is on range again.
+ */
+struct node_range_threshold {
+    struct node_range_values values;
+    int hysteresis; // Units inside the bound needed to leave ABOVE/BELOW_OF_RANGE
+    int dwell; // ms a new state must hold before firing
+    int interval; // Min ms between two events
+    int state; // Last reported state: NODE_RANGE_ON, ABOVE/BELOW_OF_RANGE or NODE_RANGE_UNKNOWN
+    int pending; // State waiting for dwell/interval
+    double pending_since;
+    double last_event;
+    node_on_range_handler_t on_range;
+    node_out_range_handler_t out_range;
+    void *user_data;
+};
+
+void node_range_threshold_init(struct node_range_threshold *t, int hysteresis, int dwell, int interval, void *user_data);
+/* Feed a sample, returns true if a handler was fired */
+bool node_range_threshold_update(struct node_range_threshold *t, int current, int min, int max);
+
 /* Initialize Nodes */
 bool mgos_nodes_init();
 
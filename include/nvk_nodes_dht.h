@@ -34,6 +34,7 @@ bool node_dht_init();
 void node_dht_sampling_handler(void *dht);
 void node_dht_tele_handler(void *dht);
 void node_dht_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *dht);
+bool node_dht_sample_is_fresh();
 float node_dht_get_temperature();
 float node_dht_get_humidity();
 void node_dht_set_temp_on_range_handler(node_on_range_handler_t func);
@@ -20,6 +20,7 @@
  */
 
 #include <stdint.h>
+#include "mgos_rpc.h"
 #include "nvk_nodes.h"
 
 #ifndef NVK_LIBS_NODES_INCLUDE_NVK_NODES_NEOPIXEL_H_
@@ -65,6 +66,22 @@ bool node_neopixel_init();
 
 rgb_color node_neopixel_get_pixel_color(int);
 
+/* Copy of the frame buffer for code that draws over it for a while, NULL without one */
+uint8_t *node_neopixel_frame_save();
+/* Puts a saved frame back without showing it and frees the copy */
+void node_neopixel_frame_restore(uint8_t *frame);
+
+/* Writes count pixels starting at first into out */
+typedef void (*node_neopixel_tile_render)(int first, int count, rgb_color *out, void *arg);
+
+/* True when frames go out chunk by chunk with no full buffer (nodes.neopixel.stream) */
+bool node_neopixel_streaming();
+
+/* Shows one frame rendered a chunk at a time, streamed or through the buffer */
+void node_neopixel_stream(node_neopixel_tile_render render, void *arg);
+
+void node_neopixel_rpc_stream_bench_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -32,6 +32,8 @@ extern "C" {
 
 bool node_photoresistor_init();
 int node_photoresistor_get_luminosity();
+int node_photoresistor_read_raw();
+bool node_photoresistor_is_dark();
 void node_photoresistor_sampling_handler(void *dht);
 void node_photoresistor_tele_handler(void *dht);
 void node_photoresistor_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *dht);
@@ -31,8 +31,12 @@ extern "C" {
 #endif
 
 bool node_pir_init();
-void node_pir_sampling_handler();
+void node_pir_sampling_handler(void *args);
+void node_pir_rpc_inject_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
 void node_pir_set_pir_toggle_handler(node_switch_handler_t func);
+int node_pir_get_state();
+int64_t node_pir_get_last_edge_time();
+bool node_pir_inject_edge(int value);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK gradient palettes. A palette is up to 16 stops "index:rrggbb,..."
+ * (index 0 - 255, increasing) expanded once into a 256 entry table, so
+ * effects get a colour with one table read per pixel. Colours before the
+ * first stop and after the last one repeat it.
+ * effects.palette.<name> in config holds the stops, a {"<name>": "..."}
+ * entry in effects.palette.file on fs takes precedence over it and the
+ * built-in palette is used when neither is set. They are read at boot.
+ * The strip palette has no built-in one: when it is set, the effects that
+ * otherwise paint strip.color (cylon, meteor, twinkle, matrix rain) sample it.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "nvk_nodes_neopixel.h"
+
+#ifndef NVK_INCLUDE_NVK_PALETTE_H_
+#define NVK_INCLUDE_NVK_PALETTE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_PALETTE_STOPS 16
+
+enum nvk_palette {
+    NVK_PALETTE_RAINBOW = 0, // rainbow and rainbow cycle
+    NVK_PALETTE_HEAT,        // fire, indexed by heat
+    NVK_PALETTE_STRIP,       // strip.color effects, when set
+    NVK_PALETTES
+};
+
+/* 256 x r, g, b */
+const uint8_t *nvk_palette_lut(enum nvk_palette palette);
+rgb_color nvk_palette_color(enum nvk_palette palette, uint8_t index);
+/* Expands stops into the palette, false and unchanged when they do not parse */
+bool nvk_palette_set(enum nvk_palette palette, const char *stops);
+bool nvk_palette_init();
+/* Grows with every palette change, for caches of rendered frames */
+uint32_t nvk_palette_generation();
+/* True when the strip palette was set and replaces strip.color */
+bool nvk_palette_strip();
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_PALETTE_H_ */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK particle engine. A fixed pool of points with fixed-point position and
+ * velocity, colour, hold time and decay, splatted additively into the strip.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef NVK_INCLUDE_NVK_PARTICLES_H_
+#define NVK_INCLUDE_NVK_PARTICLES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_PARTICLES_MAX 48
+#define NVK_PARTICLES_RANDOM -1
+#define NVK_PARTICLES_PALETTE -2 // Random colour of the strip palette
+
+/* Spawn recipe, effects built on particles are mostly one of these */
+struct particle_emitter {
+    int rate; // New particles per frame x256 (384 = 1.5 per frame)
+    int position; // Q8.8 pixel, NVK_PARTICLES_RANDOM for anywhere on the strip
+    int velocity; // Q8.8 pixels per frame
+    int color; // 0xRRGGBB, NVK_PARTICLES_RANDOM or NVK_PARTICLES_PALETTE
+    int hold_min; // Frames at full brightness before decaying
+    int hold_max;
+    int decay; // Brightness lost per frame x256 once the hold is over (0 - 255, at least 1 a frame)
+};
+
+void particles_reset();
+/* Returns the particle index or -1 if the pool is full */
+int particles_spawn(int position, int velocity, int color, int hold, int decay);
+void particles_emit(const struct particle_emitter *e, int num_pixels);
+/* Advance every particle one frame and retire the dead or off strip ones */
+void particles_update(int num_pixels);
+/* Add every particle into the framebuffer, does not clear or show */
+void particles_render(int num_pixels);
+int particles_count();
+/* The whole pool as one block, for effect suspend/resume */
+void *particles_state(size_t *size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_PARTICLES_H_ */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK driver scheduler. A hierarchical timer wheel driven by a single mgos
+ * timer owns every periodic and one-shot task of the driver.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mgos_rpc.h"
+
+#ifndef NVK_INCLUDE_NVK_SCHED_H_
+#define NVK_INCLUDE_NVK_SCHED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_SCHED_MAX_TASKS 24
+#define NVK_SCHED_INVALID_ID 0
+
+typedef uint32_t nvk_sched_id;
+typedef void (*nvk_sched_cb_t)(void *arg);
+
+enum nvk_sched_group {
+    NVK_SCHED_GROUP_NODES = 0, // Sensor sampling and telemetry, never cancelled by mode changes
+    NVK_SCHED_GROUP_MODE = 1   // Effects, ramps and alerts of the current driver mode
+};
+
+/* Run cb after msecs, and every msecs after that if repeat. Same contract as mgos_set_timer */
+nvk_sched_id nvk_sched_set(int msecs, bool repeat, enum nvk_sched_group group, nvk_sched_cb_t cb, void *arg);
+/* Cancel a task, stale or already fired ids are ignored */
+bool nvk_sched_clear(nvk_sched_id id);
+/* Cancel every task of a group, returns how many were cancelled */
+int nvk_sched_clear_group(enum nvk_sched_group group);
+bool nvk_sched_init();
+void nvk_sched_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_SCHED_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK effect suspend/resume. An effect being left saves its state (the
+ * statics it lists as regions) and the frame on the strip in a slot; coming
+ * back copies both back so it continues where it was, without reinit.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef NVK_INCLUDE_NVK_SUSPEND_H_
+#define NVK_INCLUDE_NVK_SUSPEND_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_SUSPEND_SLOTS 2 // The oldest saved effect is dropped first
+#define NVK_SUSPEND_MAX_REGIONS 4
+
+struct nvk_suspend_region {
+    void *ptr;
+    size_t size;
+};
+
+#define NVK_SUSPEND_REGION(v) ((struct nvk_suspend_region) { &(v), sizeof(v) })
+
+bool nvk_suspend_save(int key, const struct nvk_suspend_region *regions, int count);
+/* Restores and shows the saved frame, false if nothing matching was saved */
+bool nvk_suspend_restore(int key, const struct nvk_suspend_region *regions, int count);
+void nvk_suspend_drop(int key);
+bool nvk_suspend_saved(int key);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_SUSPEND_H_ */
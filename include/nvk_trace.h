@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK motion to light latency trace.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mgos_rpc.h"
+
+#ifndef NVK_INCLUDE_NVK_TRACE_H_
+#define NVK_INCLUDE_NVK_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVK_TRACE_HISTORY 32
+
+enum nvk_trace_stage {
+    NVK_TRACE_EDGE = 0,   // PIR edge (ISR timestamp)
+    NVK_TRACE_TOGGLE = 1, // node_pir_toggle_handler
+    NVK_TRACE_MOTION = 2, // motion_handler
+    NVK_TRACE_DARK = 3,   // is_dark() resolved
+    NVK_TRACE_RAMP = 4,   // first smooth_turn_on step
+    NVK_TRACE_SHOW = 5,   // first show() after the edge
+    NVK_TRACE_STAGES = 6
+};
+
+/* Open a trace for the edge captured at edge_time (uptime us) */
+void nvk_trace_begin(int64_t edge_time);
+/* Stamp a stage of the open trace, only the first stamp of a stage counts */
+void nvk_trace_stamp(enum nvk_trace_stage stage);
+/* Close the open trace and keep it in the history */
+void nvk_trace_end();
+bool nvk_trace_is_open();
+void nvk_trace_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_TRACE_H_ */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVK web UI server. Serves the assets built by tools/build_web.py with
+ * gzip encoding, strong ETags and long cache lifetimes for fingerprinted
+ * assets, answering 304 on revalidation.
+ */
+
+#include <stdbool.h>
+
+#ifndef NVK_INCLUDE_NVK_WEB_H_
+#define NVK_INCLUDE_NVK_WEB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool nvk_web_init();
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NVK_INCLUDE_NVK_WEB_H_ */
@@ -14,13 +14,13 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#include "math.h"
 #include "mgos.h"
 #include "mgos_utils.h"
 #include "mgos_time.h"
 #include "mgos_timers.h"
 #include "mgos_gpio.h"
 #include "mgos_rpc.h"
+#include "frozen.h"
 #include "mgos_mqtt.h"
 #include "mgos_blynk.h"
 #include "nvk_nodes.h"
@@ -28,6 +28,17 @@
 #include "nvk_nodes_pir.h"
 #include "nvk_nodes_photoresistor.h"
 #include "nvk_nodes_neopixel.h"
+#include "nvk_trace.h"
+#include "nvk_log.h"
+#include "nvk_sched.h"
+#include "nvk_fcache.h"
+#include "nvk_web.h"
+#include "nvk_live.h"
+#include "nvk_clock.h"
+#include "nvk_suspend.h"
+#include "nvk_matrix.h"
+#include "nvk_palette.h"
+#include "nvk_fixed.h"
 #include "effect_default.h"
 #include "effect_strobe.h"
 #include "effect_cylon.h"
@@ -39,8 +50,12 @@
 #include "effect_fire.h"
 #include "effect_snow.h"
 #include "effect_meteor.h"
+#include "effect_audio.h"
+#include "effect_program.h"
+#include "effect_anim.h"
+#include "effect_matrix.h"
 
-#define TOTAL_EFFECTS 13
+#define TOTAL_EFFECTS 19
 
 #define MODE_OFF 0
 #define MODE_ON 1
@@ -48,16 +63,30 @@
 #define MODE_NIGHT 3
 #define MODE_VIGILANCE 4
 
-static mgos_timer_id effect_timer = MGOS_INVALID_TIMER_ID;
-static mgos_timer_id smooth_timer = MGOS_INVALID_TIMER_ID;
-static mgos_timer_id alert_timer = MGOS_INVALID_TIMER_ID;
-static float last_motion_time = 0;
+#define EFFECT_KEY_NONE -1
+#define EFFECT_KEY_VIGILANCE TOTAL_EFFECTS // Cylon of the vigilance mode
+
+static nvk_sched_id effect_timer = NVK_SCHED_INVALID_ID;
+static nvk_sched_id smooth_timer = NVK_SCHED_INVALID_ID;
+static nvk_sched_id alert_timer = NVK_SCHED_INVALID_ID;
+static int32_t last_motion_time = 0; // Uptime (s)
 static int smooth_brightness = 0;
+static int s_running_effect = EFFECT_KEY_NONE;
 
 static neopixel_effect_data s_neopixel_effect_data = { 0 };
+static struct fcache_effect s_rainbow_cached = {
+  rainbow_effect, NULL, RAINBOW_EFFECT_PERIOD, &s_rainbow_effect_counter
+};
+static struct fcache_effect s_fade_cached = { fade_effect, NULL, FADE_EFFECT_PERIOD, &s_fade_effect_counter };
+static struct fcache_effect s_flash_cached = { flash_effect, NULL, FLASH_EFFECT_PERIOD, &s_flash_effect_counter };
+static struct fcache_effect s_rgb_loop_cached = {
+  rbg_loop_effect, NULL, RGB_LOOP_EFFECT_PERIOD, &s_rgb_loop_effect_counter
+};
 
 const char MOTION_ALERT_JSON_FMT[] = "{uptime:%f}";
-const char RPC_DEVICE_STATE_JSON_FMT[] = "{id:\"%s\",mode:%d,temp:%d,humd:%d,lum:%d}";
+const char RPC_DEVICE_STATE_JSON_FMT[] = "{id:%Q,version:%u,mode:%d,temp:%d,humd:%d,lum:%d,"
+  "effect:%d,color:%d,brightness:%d,pir:%d,last_motion:%d,power:%d,power_limit:%d,dht_valid:%B}";
+const char RPC_DEVICE_STATE_UNCHANGED_JSON_FMT[] = "{version:%u,unchanged:true}";
 const char RPC_SUCCESS_RESPONSE_JSON_FMT[] = "{success:true}";
 const char EFFECTS_LIST[][16] = {
   "default",
@@ -72,28 +101,120 @@ const char EFFECTS_LIST[][16] = {
   "twinkle random",
   "fire",
   "snow",
-  "meteor"
+  "meteor",
+  "audio VU meter",
+  "audio spectrum",
+  "audio beat",
+  "program",
+  "animation",
+  "matrix rain"
 };
 
-static void clear_timers() {
-  if(effect_timer != MGOS_INVALID_TIMER_ID) {
-    mgos_clear_timer(effect_timer);
-    effect_timer = MGOS_INVALID_TIMER_ID;
+static const char *effect_name(int32_t effect) {
+  return effect >= 0 && effect < TOTAL_EFFECTS ? EFFECTS_LIST[effect] : NULL;
+}
+
+/* Statics an effect needs to continue where it was left */
+static int effect_state_regions(int key, struct nvk_suspend_region *r) {
+  size_t size;
+  switch(key) {
+    case 0:
+      r[0] = NVK_SUSPEND_REGION(s_first_effect_counter);
+      return 1;
+    case 1:
+      r[0] = NVK_SUSPEND_REGION(s_strobe_effect_state);
+      return 1;
+    case 2:
+    case EFFECT_KEY_VIGILANCE:
+      r[0] = NVK_SUSPEND_REGION(s_cylon_effect_dir);
+      r[1] = NVK_SUSPEND_REGION(s_cylon_effect_counter);
+      return 2;
+    case 3:
+      r[0] = NVK_SUSPEND_REGION(s_rainbow_effect_counter);
+      return 1;
+    case 4:
+      r[0] = NVK_SUSPEND_REGION(s_rainbow_cycle_effect_counter);
+      return 1;
+    case 5:
+      r[0] = NVK_SUSPEND_REGION(s_fade_effect_counter);
+      return 1;
+    case 6:
+      r[0] = NVK_SUSPEND_REGION(s_flash_effect_counter);
+      return 1;
+    case 7:
+      r[0] = NVK_SUSPEND_REGION(s_rgb_loop_effect_counter);
+      return 1;
+    case 8:
+    case 9:
+      r[0].ptr = particles_state(&size);
+      r[0].size = size;
+      return 1;
+    case 10:
+      r[0] = NVK_SUSPEND_REGION(heat);
+      return 1;
+    case 11:
+      r[0] = NVK_SUSPEND_REGION(s_snow_flakes);
+      return 1;
+    case 12:
+      r[0] = NVK_SUSPEND_REGION(s_meteor_effect_counter);
+      r[1].ptr = particles_state(&size);
+      r[1].size = size;
+      return 2;
+    case 15:
+      r[0] = NVK_SUSPEND_REGION(s_audio_beat_level);
+      return 1;
+    case 16:
+      r[0] = NVK_SUSPEND_REGION(s_program_effect_frame);
+      return 1;
+    case 17:
+      r[0] = NVK_SUSPEND_REGION(s_anim_effect_frame); // The file stays open at its position
+      return 1;
   }
-  if(smooth_timer != MGOS_INVALID_TIMER_ID) {
-    mgos_clear_timer(smooth_timer);
-    smooth_timer = MGOS_INVALID_TIMER_ID;
+  return 0; // Only the frame, the audio effects follow the live input
+}
+
+static void effect_suspend() {
+  if (s_running_effect == EFFECT_KEY_NONE) {
+    return;
   }
-  if(alert_timer != MGOS_INVALID_TIMER_ID) {
-    mgos_clear_timer(alert_timer);
-    alert_timer = MGOS_INVALID_TIMER_ID;
+  struct nvk_suspend_region r[NVK_SUSPEND_MAX_REGIONS];
+  nvk_suspend_save(s_running_effect, r, effect_state_regions(s_running_effect, r));
+  s_running_effect = EFFECT_KEY_NONE;
+}
+
+static bool effect_resume(int key) {
+  struct nvk_suspend_region r[NVK_SUSPEND_MAX_REGIONS];
+  return nvk_suspend_restore(key, r, effect_state_regions(key, r));
+}
+
+/* Cancels every task of the current mode, including untracked one-shots.
+ * The running effect is suspended, the frame cache is kept for its return */
+static void clear_timers() {
+  effect_suspend();
+  if (!nvk_suspend_saved(17)) {
+    nvk_anim_close(); // Kept open only while the animation can be resumed
   }
+  audio_stop();
+  nvk_sched_clear_group(NVK_SCHED_GROUP_MODE);
+  effect_timer = NVK_SCHED_INVALID_ID;
+  smooth_timer = NVK_SCHED_INVALID_ID;
+  alert_timer = NVK_SCHED_INVALID_ID;
+}
+
+static nvk_sched_id set_timer(int msecs, bool repeat, nvk_sched_cb_t cb, void *arg) {
+  return nvk_sched_set(msecs, repeat, NVK_SCHED_GROUP_MODE, cb, arg);
+}
+
+static void set_mode(int mode) {
+  mgos_sys_config_set_app_mode(mode);
+  nvk_live_set(NVK_LIVE_MODE, mode);
+  nvk_live_set(NVK_LIVE_BRIGHTNESS, mode == MODE_NIGHT ? smooth_brightness : mgos_sys_config_get_strip_brightness());
 }
 
 static void strip_turn_off() {
   clear_timers();
   node_neopixel_turn_off();
-  mgos_sys_config_set_app_mode(MODE_OFF);
+  set_mode(MODE_OFF);
   LOG(LL_INFO, ("Led Strip Turn OFF"));
 }
 
@@ -105,75 +226,132 @@ static void strip_turn_on() {
   }
   rgb_color c = get_rgb_color(color);
   node_neopixel_turn_on(c);
-  mgos_sys_config_set_app_mode(MODE_ON);
+  set_mode(MODE_ON);
   LOG(LL_INFO, ("Led Strip Turn ON"));
 }
 
 static bool is_dark() {
-  return node_photoresistor_get_luminosity() <= mgos_sys_config_get_pir_threshold();
+  bool dark = node_photoresistor_is_dark();
+  nvk_trace_stamp(NVK_TRACE_DARK);
+  return dark;
 }
 
 static void start_effect() {
   clear_timers();
   int effect = mgos_sys_config_get_strip_effect();
   int speed = mgos_sys_config_get_strip_speed();
+  nvk_live_set(NVK_LIVE_EFFECT, effect);
+  bool resumed = effect_resume(effect);
+  if (effect >= 13 && effect <= 15 && !audio_start()) {
+    LOG(LL_INFO, ("No audio input"));
+  }
   switch(effect) {
     case 0:
-      effect_timer = mgos_set_timer(speed / 4 * 3, MGOS_TIMER_REPEAT, first_effect, NULL);
+      effect_timer = set_timer(speed / 4 * 3, true, first_effect, NULL);
       break;
     case 1:
       s_neopixel_effect_data.color = mgos_sys_config_get_strip_color();
-      effect_timer = mgos_set_timer(speed, MGOS_TIMER_REPEAT, strobe_effect, &s_neopixel_effect_data);
+      effect_timer = set_timer(speed, true, strobe_effect, &s_neopixel_effect_data);
       break;
     case 2:
       s_neopixel_effect_data.color = mgos_sys_config_get_strip_color();
-      effect_timer = mgos_set_timer(speed / 4 * 3, MGOS_TIMER_REPEAT, cylon_effect, &s_neopixel_effect_data);
+      effect_timer = set_timer(speed / 4 * 3, true, cylon_effect, &s_neopixel_effect_data);
       break;
     case 3:
-      effect_timer = mgos_set_timer(speed, MGOS_TIMER_REPEAT, rainbow_effect, NULL);
+      effect_timer = set_timer(speed, true, fcache_effect, &s_rainbow_cached);
       break;
     case 4:
-      effect_timer = mgos_set_timer(speed, MGOS_TIMER_REPEAT, rainbow_cycle_effect, NULL);
+      effect_timer = set_timer(speed, true, rainbow_cycle_effect, NULL);
       break;
     case 5:
-      effect_timer = mgos_set_timer(speed / 4, MGOS_TIMER_REPEAT, fade_effect, NULL);
+      effect_timer = set_timer(speed / 4, true, fcache_effect, &s_fade_cached);
       break;
     case 6:
-      effect_timer = mgos_set_timer(speed * 3, MGOS_TIMER_REPEAT, flash_effect, NULL);
+      effect_timer = set_timer(speed * 3, true, fcache_effect, &s_flash_cached);
       break;
     case 7:
-      effect_timer = mgos_set_timer(speed / 5, MGOS_TIMER_REPEAT, rbg_loop_effect, NULL);
+      effect_timer = set_timer(speed / 5, true, fcache_effect, &s_rgb_loop_cached);
       break;
     case 8:
-      node_neopixel_set_all_pixels(get_rgb_color(0));
+      if (!resumed) {
+        particles_reset();
+        node_neopixel_set_all_pixels(get_rgb_color(0));
+      }
       s_neopixel_effect_data.color = mgos_sys_config_get_strip_color();
-      effect_timer = mgos_set_timer(speed, MGOS_TIMER_REPEAT, twinkle_effect, &s_neopixel_effect_data);
+      effect_timer = set_timer(speed, true, twinkle_effect, &s_neopixel_effect_data);
       break;
     case 9:
-      node_neopixel_set_all_pixels(get_rgb_color(0));
-      effect_timer = mgos_set_timer(speed, MGOS_TIMER_REPEAT, twinkle_random_effect, NULL);
+      if (!resumed) {
+        particles_reset();
+        node_neopixel_set_all_pixels(get_rgb_color(0));
+      }
+      effect_timer = set_timer(speed, true, twinkle_random_effect, NULL);
       break;
     case 10:
-      effect_timer = mgos_set_timer(speed / 10, MGOS_TIMER_REPEAT, fire_effect, NULL);
+      effect_timer = set_timer(speed / 10, true, fire_effect, NULL);
       break;
     case 11:
-      snow_effect();
+      if (!resumed) {
+        snow_effect_start();
+      }
+      effect_timer = set_timer(speed / 10, true, snow_effect, NULL);
       break;
     case 12:
-      effect_timer = mgos_set_timer(speed / 7, MGOS_TIMER_REPEAT, meteor_effect, NULL);
+      if (!resumed) {
+        s_meteor_effect_counter = 0;
+      }
+      effect_timer = set_timer(speed / 7, true, meteor_effect, NULL);
+      break;
+    case 13:
+      effect_timer = set_timer(AUDIO_EFFECT_FRAME_MS, true, audio_vu_effect, NULL);
+      break;
+    case 14:
+      effect_timer = set_timer(AUDIO_EFFECT_FRAME_MS, true, audio_spectrum_effect, NULL);
+      break;
+    case 15:
+      s_neopixel_effect_data.color = mgos_sys_config_get_strip_color();
+      effect_timer = set_timer(AUDIO_EFFECT_FRAME_MS, true, audio_beat_effect, &s_neopixel_effect_data);
+      break;
+    case 16:
+      if (fxvm_active() == NULL && !fxvm_load()) {
+        LOG(LL_INFO, ("No effect program loaded"));
+      }
+      if (!resumed) {
+        s_program_effect_frame = 0;
+      }
+      effect_timer = set_timer(speed / 10, true, program_effect, NULL);
+      break;
+    case 17: {
+      int frame_ms = resumed && nvk_anim_header() != NULL ? nvk_anim_header()->frame_ms : anim_effect_start();
+      if (frame_ms <= 0) {
+        frame_ms = speed / 10;
+      }
+      effect_timer = set_timer(frame_ms, true, anim_effect, NULL);
+      break;
+    }
+    case 18:
+      if (nvk_matrix_width() == 0) {
+        LOG(LL_INFO, ("No matrix layout for the matrix effect"));
+      }
+      if (!resumed) {
+        node_neopixel_set_all_pixels(get_rgb_color(0));
+      }
+      s_neopixel_effect_data.color = mgos_sys_config_get_strip_color();
+      effect_timer = set_timer(speed / 5, true, matrix_rain_effect, &s_neopixel_effect_data);
       break;
     default:
       LOG(LL_INFO, ("Bad effect: %d", effect));
       strip_turn_off();
       return;
   }
-  LOG(LL_INFO, ("Starting %s effect...", EFFECTS_LIST[effect]));
+  s_running_effect = effect;
+  NVK_LOG1(NVK_LOG_DRIVER, LL_INFO, NVK_LOG_MSG_EFFECT_START, effect);
 }
 
 static void start_night_light() {
   clear_timers();
   node_neopixel_turn_off();
-  mgos_sys_config_set_app_mode(MODE_NIGHT);
+  set_mode(MODE_NIGHT);
   LOG(LL_INFO, ("Starting night light"));
 }
 
@@ -181,8 +359,10 @@ static void start_vigilance() {
   clear_timers();
   int speed = mgos_sys_config_get_strip_speed() / 2;
   s_neopixel_effect_data.color = mgos_sys_config_get_strip_color();
-  effect_timer = mgos_set_timer(speed, MGOS_TIMER_REPEAT, cylon_effect, &s_neopixel_effect_data);
-  mgos_sys_config_set_app_mode(MODE_VIGILANCE);
+  effect_resume(EFFECT_KEY_VIGILANCE); // The cylon continues after an alert
+  effect_timer = set_timer(speed, true, cylon_effect, &s_neopixel_effect_data);
+  s_running_effect = EFFECT_KEY_VIGILANCE;
+  set_mode(MODE_VIGILANCE);
 }
 
 /*
@@ -201,25 +381,32 @@ static void smooth_turn_off() {
     node_neopixel_set_brightness(0);
     clear_timers();
   }
+  nvk_live_set(NVK_LIVE_BRIGHTNESS, smooth_brightness);
+}
+
+/* Whole seconds of uptime without going through the double of mgos_uptime() */
+static int32_t uptime_seconds() {
+  return (int32_t) (mgos_uptime_micros() / 1000000);
 }
 
 static void check_last_motion_time() {
-  int current_time = mgos_uptime();
+  int32_t current_time = uptime_seconds();
   if (current_time > last_motion_time) {
-    int diff = mgos_uptime() - last_motion_time;
+    int diff = current_time - last_motion_time;
     if (diff < mgos_sys_config_get_pir_keep()) {
       int wait = (mgos_sys_config_get_pir_keep() - diff) * 1000;
-      mgos_set_timer(wait, false, check_last_motion_time, NULL);
+      set_timer(wait, false, check_last_motion_time, NULL);
     } else {
       clear_timers();
-      smooth_timer = mgos_set_timer(1000, MGOS_TIMER_REPEAT, smooth_turn_off, NULL);
+      smooth_timer = set_timer(1000, true, smooth_turn_off, NULL);
     }
   } else {
-    mgos_set_timer(mgos_sys_config_get_pir_keep() * 1000, false, check_last_motion_time, NULL);
+    set_timer(mgos_sys_config_get_pir_keep() * 1000, false, check_last_motion_time, NULL);
   }
 }
 
 static void smooth_turn_on() {
+  nvk_trace_stamp(NVK_TRACE_RAMP);
   smooth_brightness += 50;
   if(smooth_brightness <= 250) {
     node_neopixel_set_brightness(smooth_brightness);
@@ -228,35 +415,50 @@ static void smooth_turn_on() {
     node_neopixel_set_brightness(255);
     clear_timers();
     int wait = mgos_sys_config_get_pir_keep() * 1000;
-    mgos_set_timer(wait, false, check_last_motion_time, NULL);
+    set_timer(wait, false, check_last_motion_time, NULL);
   }
+  nvk_live_set(NVK_LIVE_BRIGHTNESS, smooth_brightness);
 }
 
 static void motion_handler() {
-  if (mgos_uptime() - last_motion_time > 4) {
-    last_motion_time = mgos_uptime();
-    LOG(LL_INFO, ("[%f] Motion detected", last_motion_time));
+  bool light_started = false;
+  nvk_trace_stamp(NVK_TRACE_MOTION);
+  if (uptime_seconds() - last_motion_time > 4) {
+    last_motion_time = uptime_seconds();
+    nvk_live_set(NVK_LIVE_MOTION, last_motion_time);
+    NVK_LOG0(NVK_LOG_DRIVER, LL_INFO, NVK_LOG_MSG_MOTION);
     switch(mgos_sys_config_get_app_mode()) {
       case MODE_NIGHT:
-        if(is_dark() && smooth_timer == MGOS_INVALID_TIMER_ID) {
+        if(is_dark() && smooth_timer == NVK_SCHED_INVALID_ID) {
+          light_started = true;
           smooth_turn_on();
-          smooth_timer = mgos_set_timer(1000, MGOS_TIMER_REPEAT, smooth_turn_on, NULL);
+          smooth_timer = set_timer(1000, true, smooth_turn_on, NULL);
         }
         break;
       case MODE_VIGILANCE:
-        if(alert_timer == MGOS_INVALID_TIMER_ID) {
+        if(alert_timer == NVK_SCHED_INVALID_ID) {
+          light_started = true;
           clear_timers();
           s_neopixel_effect_data.color = mgos_sys_config_get_strip_color();
-          effect_timer = mgos_set_timer(100, MGOS_TIMER_REPEAT, strobe_effect, &s_neopixel_effect_data);
-          alert_timer = mgos_set_timer(15000, false, start_vigilance, NULL);
+          effect_timer = set_timer(100, true, strobe_effect, &s_neopixel_effect_data);
+          alert_timer = set_timer(15000, false, start_vigilance, NULL);
           mgos_mqtt_pubf("alert/motion", 1, false, MOTION_ALERT_JSON_FMT, mgos_uptime());
         }
         break;
     }
   }
+  // Traces that never reach show() are kept with the stages they did reach
+  if (!light_started) {
+    nvk_trace_end();
+  }
 }
 
 void node_pir_toggle_handler(int value, void *user_data) {
+    if(value) {
+      nvk_trace_begin(node_pir_get_last_edge_time());
+      nvk_trace_stamp(NVK_TRACE_TOGGLE);
+    }
+    nvk_live_set(NVK_LIVE_PIR, value);
     if(mgos_sys_config_get_pir_indicator()) {
       mgos_gpio_write(mgos_sys_config_get_pins_led(), value);
     }
@@ -268,12 +470,21 @@ void node_pir_toggle_handler(int value, void *user_data) {
 
 static void rpc_get_device_state(struct mg_rpc_request_info *ri, const char *args,
                            const char *src, void *user_data) {
-  const char* id = mgos_sys_config_get_device_id();
-  int mode = mgos_sys_config_get_app_mode();
-  int temp = (int) node_dht_get_temperature();
-  int humd = (int) node_dht_get_humidity();
-  int lumi = node_photoresistor_get_luminosity();
-  mg_rpc_send_responsef(ri, RPC_DEVICE_STATE_JSON_FMT, id, mode, temp, humd, lumi);
+  // Everything comes from the live snapshot, no sensor access here
+  uint32_t version = nvk_live_version();
+  unsigned int since = 0;
+  json_scanf(args, strlen(args), "{since_version: %u}", &since);
+  if (since == version) {
+    mg_rpc_send_responsef(ri, RPC_DEVICE_STATE_UNCHANGED_JSON_FMT, version);
+    return;
+  }
+  mg_rpc_send_responsef(ri, RPC_DEVICE_STATE_JSON_FMT, mgos_sys_config_get_device_id(), version,
+                        nvk_live_get(NVK_LIVE_MODE), nvk_live_get(NVK_LIVE_TEMP),
+                        nvk_live_get(NVK_LIVE_HUMD), nvk_live_get(NVK_LIVE_LUM),
+                        nvk_live_get(NVK_LIVE_EFFECT), nvk_live_get(NVK_LIVE_COLOR),
+                        nvk_live_get(NVK_LIVE_BRIGHTNESS), nvk_live_get(NVK_LIVE_PIR),
+                        nvk_live_get(NVK_LIVE_MOTION), nvk_live_get(NVK_LIVE_POWER),
+                        nvk_live_get(NVK_LIVE_POWER_LIMIT), nvk_live_get(NVK_LIVE_DHT_VALID));
   (void) args;
   (void) src;
   (void) user_data;
@@ -305,7 +516,7 @@ static void rpc_set_effect_cb(struct mg_rpc_request_info *ri, const char *args,
     return;
   }
   mgos_sys_config_set_strip_effect(e);
-  mgos_sys_config_set_app_mode(MODE_EFFECT);
+  set_mode(MODE_EFFECT);
   start_effect();
   mg_rpc_send_responsef(ri, RPC_SUCCESS_RESPONSE_JSON_FMT);
   (void) args;
@@ -323,7 +534,7 @@ static void rpc_set_next_effect_cb(struct mg_rpc_request_info *ri, const char *a
     }
     mgos_sys_config_set_strip_effect(e);
   } else {
-    mgos_sys_config_set_app_mode(MODE_EFFECT);
+    set_mode(MODE_EFFECT);
   }
   start_effect();
   mg_rpc_send_responsef(ri, RPC_SUCCESS_RESPONSE_JSON_FMT);
@@ -355,6 +566,7 @@ static void rpc_set_color_cb(struct mg_rpc_request_info *ri, const char *args,
   int color = atoi(args);
   LOG(LL_INFO, ("Set color: %d", color & 0xFFFFFF));
   mgos_sys_config_set_strip_color(color & 0xFFFFFF);
+  nvk_live_set(NVK_LIVE_COLOR, color & 0xFFFFFF);
   if(mgos_sys_config_get_app_mode() == MODE_OFF) {
     strip_turn_on();
   }
@@ -364,65 +576,183 @@ static void rpc_set_color_cb(struct mg_rpc_request_info *ri, const char *args,
   (void) user_data;
 }
 
-static void custom_blynk_handler(struct mg_connection *c, const char *cmd, int pin, int val, int id, void *user_data) {
-  LOG(LL_INFO, ("custom_blynk_handler"));
-  if (strcmp(cmd, "vr") == 0) {
-    /*if (pin == s_read_virtual_pin) {
-      blynk_virtual_write(c, id, s_read_virtual_pin,
-                          (float) mgos_get_free_heap_size() / 1024);
-    }*/
-    switch(pin) {
-      case 0:
-        LOG(LL_INFO, ("Blynk::vr::Temp"));
-        break;
-      case 1:
-        LOG(LL_INFO, ("Blynk::vr::Humd"));
-        break;
-      case 2:
-        LOG(LL_INFO, ("Blynk::vr::Lum"));
-        break;
-      default:
-        LOG(LL_INFO, ("Bad virtual read pin"));
+static bool apply_mode(int mode) {
+  switch(mode) {
+    case MODE_OFF:
+      strip_turn_off();
+      break;
+    case MODE_ON:
+      strip_turn_on();
+      break;
+    case MODE_EFFECT:
+      set_mode(MODE_EFFECT);
+      start_effect();
+      break;
+    case MODE_NIGHT:
+      start_night_light();
+      break;
+    case MODE_VIGILANCE:
+      start_vigilance();
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+static int blynk_get_temp() {
+  return nvk_live_get(NVK_LIVE_TEMP);
+}
+
+static int blynk_get_humd() {
+  return nvk_live_get(NVK_LIVE_HUMD);
+}
+
+static int blynk_get_lum() {
+  return nvk_live_get(NVK_LIVE_LUM);
+}
+
+static void blynk_set_led(int value) {
+  mgos_gpio_write(mgos_sys_config_get_pins_led(), value != 0);
+}
+
+static void blynk_set_mode(int value) {
+  if (!apply_mode(value)) {
+    LOG(LL_INFO, ("Blynk: bad mode %d", value));
+  }
+}
+
+static void blynk_set_onoff(int value) {
+  if (value) {
+    strip_turn_on();
+  } else {
+    strip_turn_off();
+  }
+}
+
+static void blynk_set_effect(int value) {
+  if (value < 0 || value >= TOTAL_EFFECTS) {
+    LOG(LL_INFO, ("Blynk: bad effect %d", value));
+    return;
+  }
+  mgos_sys_config_set_strip_effect(value);
+  apply_mode(MODE_EFFECT);
+}
+
+static void blynk_set_color(int value) {
+  mgos_sys_config_set_strip_color(value & 0xFFFFFF);
+  nvk_live_set(NVK_LIVE_COLOR, value & 0xFFFFFF);
+  if(mgos_sys_config_get_app_mode() == MODE_OFF) {
+    strip_turn_on();
+  }
+}
+
+struct blynk_binding {
+  int pin;
+  int (*get)();
+  void (*set)(int value);
+};
+
+static const struct blynk_binding BLYNK_BINDINGS[] = {
+  { 0, blynk_get_temp, NULL },
+  { 1, blynk_get_humd, NULL },
+  { 2, blynk_get_lum, NULL },
+  { 3, NULL, blynk_set_led },
+  { 4, NULL, blynk_set_mode },
+  { 5, NULL, blynk_set_onoff },
+  { 6, NULL, blynk_set_effect },
+  { 7, NULL, blynk_set_color }
+};
+
+#define BLYNK_BINDINGS_SIZE (sizeof(BLYNK_BINDINGS) / sizeof(BLYNK_BINDINGS[0]))
+
+/* Latest write per pin, applied once per app.blynk.throttle window */
+static struct {
+  bool write;
+  int value;
+  uint32_t seq; // Arrival of the latest write, pins are applied in this order
+} s_blynk_pending[BLYNK_BINDINGS_SIZE];
+static uint32_t s_blynk_seq = 0;
+static nvk_sched_id s_blynk_flush_timer = NVK_SCHED_INVALID_ID;
+/* Last answer per pin, reads are answered at most once per window */
+static int64_t s_blynk_answered[BLYNK_BINDINGS_SIZE];
+
+static void blynk_flush(void *arg) {
+  s_blynk_flush_timer = NVK_SCHED_INVALID_ID;
+  // The last request wins, so V6 (effect) then V4 (mode off) ends off
+  for (;;) {
+    size_t next = BLYNK_BINDINGS_SIZE;
+    for (size_t b = 0; b < BLYNK_BINDINGS_SIZE; b++) {
+      if (s_blynk_pending[b].write &&
+          (next == BLYNK_BINDINGS_SIZE || (int32_t) (s_blynk_pending[b].seq - s_blynk_pending[next].seq) < 0)) {
+        next = b;
+      }
     }
-  } else if (strcmp(cmd, "vw") == 0) {
-    /*if (pin == s_write_virtual_pin) {
-      mgos_gpio_set_mode(s_led_pin, MGOS_GPIO_MODE_OUTPUT);
-      mgos_gpio_write(s_led_pin, val);
-    }*/
-    switch(pin) {
-      case 3:
-        LOG(LL_INFO, ("Blynk::vw::Led"));
-        break;
-      case 4:
-        LOG(LL_INFO, ("Blynk::vw::Mode"));
-        break;
-      case 5:
-        LOG(LL_INFO, ("Blynk::vw::OnOff"));
-        break;
-      case 6:
-        LOG(LL_INFO, ("Blynk::vw::Effect"));
-        break;
-      case 7:
-        LOG(LL_INFO, ("Blynk::vw::Color"));
-        break;
-      default:
-        LOG(LL_INFO, ("Bad virtual write pin"));
+    if (next == BLYNK_BINDINGS_SIZE) {
+      break;
+    }
+    s_blynk_pending[next].write = false;
+    BLYNK_BINDINGS[next].set(s_blynk_pending[next].value);
+  }
+  (void) arg;
+}
+
+static void custom_blynk_handler(struct mg_connection *c, const char *cmd, int pin, int val, int id, void *user_data) {
+  bool read = strcmp(cmd, "vr") == 0;
+  if (!read && strcmp(cmd, "vw") != 0) {
+    return;
+  }
+  size_t b = 0;
+  while (b < BLYNK_BINDINGS_SIZE && BLYNK_BINDINGS[b].pin != pin) {
+    b++;
+  }
+  if (b == BLYNK_BINDINGS_SIZE || (read ? BLYNK_BINDINGS[b].get == NULL : BLYNK_BINDINGS[b].set == NULL)) {
+    LOG(LL_INFO, ("Blynk: no %s binding for V%d", cmd, pin));
+    return;
+  }
+  if (read) {
+    // Getters only read the live snapshot, so reads are answered at once on the
+    // connection that asked. A deferred answer could outlive a reconnect.
+    // Widgets polling faster than the window are left with the last value.
+    int64_t now = mgos_uptime_micros();
+    if (s_blynk_answered[b] != 0 && now - s_blynk_answered[b] < mgos_sys_config_get_app_blynk_throttle() * 1000LL) {
+      return;
     }
+    s_blynk_answered[b] = now;
+    blynk_virtual_write(c, pin, BLYNK_BINDINGS[b].get(), id);
+    return;
+  }
+  s_blynk_pending[b].write = true;
+  s_blynk_pending[b].value = val;
+  s_blynk_pending[b].seq = s_blynk_seq++;
+  if (s_blynk_flush_timer == NVK_SCHED_INVALID_ID) {
+    // Not in the mode group, a mode change must not drop pending requests
+    s_blynk_flush_timer = nvk_sched_set(mgos_sys_config_get_app_blynk_throttle(), false,
+                                        NVK_SCHED_GROUP_NODES, blynk_flush, NULL);
   }
-  (void) c;
-  (void) val;
-  (void) id;
   (void) user_data;
 }
 
 enum mgos_app_init_result mgos_app_init(void) {
 
+  nvk_log_init();
+  nvk_log_set_name_lookup(NVK_LOG_MSG_EFFECT_START, effect_name);
+  nvk_sched_init();
+  nvk_clock_init();
+
   if(mgos_nodes_init()) {
     node_pir_set_pir_toggle_handler(node_pir_toggle_handler);
   } else {
     LOG(LL_ERROR, ("Error initializing the nodes"));
   }
 
+  if (!nvk_palette_init()) {
+    LOG(LL_ERROR, ("Error loading the palettes, using the built-in ones"));
+  }
+  if (!nvk_matrix_init()) {
+    LOG(LL_ERROR, ("Error initializing the matrix layout"));
+  }
+
   // Configure Built in LED
   /*mgos_gpio_set_mode(mgos_sys_config_get_pins_bled(), MGOS_GPIO_MODE_OUTPUT);
   mgos_set_timer(1000, MGOS_TIMER_REPEAT, bled_timer_cb, NULL);*/
@@ -439,6 +769,22 @@ enum mgos_app_init_result mgos_app_init(void) {
   mgos_rpc_add_handler("Driver.Night", rpc_set_night_light_cb, NULL);
   mgos_rpc_add_handler("Driver.Vigilance", rpc_set_vigilance_cb, NULL);
   mgos_rpc_add_handler("Driver.Color", rpc_set_color_cb, NULL);
+  mgos_rpc_add_handler("Driver.Trace", nvk_trace_rpc_stat_handler, NULL);
+  mgos_rpc_add_handler("Driver.Sched", nvk_sched_rpc_stat_handler, NULL);
+  mgos_rpc_add_handler("Driver.Log", nvk_log_rpc_drain_handler, NULL);
+  mgos_rpc_add_handler("Driver.LogLevel", nvk_log_rpc_level_handler, NULL);
+  mgos_rpc_add_handler("Driver.Program", fxvm_rpc_upload_handler, NULL);
+  mgos_rpc_add_handler("Driver.ProgramBench", fxvm_rpc_bench_handler, NULL);
+  mgos_rpc_add_handler("Driver.StreamBench", node_neopixel_rpc_stream_bench_handler, NULL);
+  mgos_rpc_add_handler("Driver.MathBench", fixed_rpc_bench_handler, NULL);
+  mgos_rpc_add_handler("Driver.AnimSeek", nvk_anim_rpc_seek_handler, NULL);
+  mgos_rpc_add_handler("Driver.Clock", nvk_clock_rpc_stat_handler, NULL);
+
+  // Configure web UI
+  nvk_web_init();
+  nvk_live_init();
+  nvk_live_set(NVK_LIVE_COLOR, mgos_sys_config_get_strip_color());
+  nvk_live_set(NVK_LIVE_EFFECT, mgos_sys_config_get_strip_effect());
 
   blynk_set_handler(custom_blynk_handler, NULL);
 
@@ -449,27 +795,11 @@ enum mgos_app_init_result mgos_app_init(void) {
   }*/
 
   int mode = mgos_sys_config_get_app_mode();
-  switch(mode) {
-    case MODE_OFF:
-      strip_turn_off();
-      break;
-    case MODE_ON:
-      strip_turn_on();
-      break;
-    case MODE_EFFECT: 
-      start_effect();
-      break;
-    case MODE_NIGHT:
-      start_night_light();
-      break;
-    case MODE_VIGILANCE:
-      start_vigilance();
-      break;
-    default:
-      LOG(LL_INFO, ("Bad mode %d", mode));
-      mgos_sys_config_set_app_mode(0);
-      // TODO: Save config and reboot
-  }  
+  if (!apply_mode(mode)) {
+    LOG(LL_INFO, ("Bad mode %d", mode));
+    set_mode(0);
+    // TODO: Save config and reboot
+  }
 
   return MGOS_APP_INIT_SUCCESS;
 }
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include "mgos.h"
+#include "mgos_rpc.h"
+#include "frozen.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_anim.h"
+
+#define NVK_ANIM_HEADER_SIZE 16
+#define NVK_ANIM_INDEX_ENTRY_SIZE 8
+
+#define NVK_ANIM_OP_SKIP 0x00
+#define NVK_ANIM_OP_RUN 0x40
+#define NVK_ANIM_OP_LITERAL 0x80
+#define NVK_ANIM_OP_END 0xC0
+
+struct nvk_anim_player {
+    FILE *file;
+    struct nvk_anim_header header;
+    int frame; // Next frame to decode
+    uint8_t buf[NVK_ANIM_READ_BUFFER];
+    int len;
+    int pos;
+};
+
+static struct nvk_anim_player s_nvk_anim = { 0 };
+
+static inline uint16_t nvk_anim_u16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t nvk_anim_u32(const uint8_t *p) {
+    return nvk_anim_u16(p) | ((uint32_t) nvk_anim_u16(p + 2) << 16);
+}
+
+static bool nvk_anim_fseek(long offset) {
+    s_nvk_anim.len = 0;
+    s_nvk_anim.pos = 0;
+    return fseek(s_nvk_anim.file, offset, SEEK_SET) == 0;
+}
+
+static bool nvk_anim_read(uint8_t *dst, int n) {
+    while (n > 0) {
+        if (s_nvk_anim.pos == s_nvk_anim.len) {
+            s_nvk_anim.len = fread(s_nvk_anim.buf, 1, sizeof(s_nvk_anim.buf), s_nvk_anim.file);
+            s_nvk_anim.pos = 0;
+            if (s_nvk_anim.len <= 0) {
+                s_nvk_anim.len = 0;
+                return false;
+            }
+        }
+        int chunk = s_nvk_anim.len - s_nvk_anim.pos;
+        if (chunk > n) {
+            chunk = n;
+        }
+        memcpy(dst, s_nvk_anim.buf + s_nvk_anim.pos, chunk);
+        s_nvk_anim.pos += chunk;
+        dst += chunk;
+        n -= chunk;
+    }
+    return true;
+}
+
+void nvk_anim_close() {
+    if (s_nvk_anim.file != NULL) {
+        fclose(s_nvk_anim.file);
+    }
+    memset(&s_nvk_anim, 0, sizeof(s_nvk_anim));
+}
+
+bool nvk_anim_open(const char *path) {
+    nvk_anim_close();
+    s_nvk_anim.file = fopen(path, "rb");
+    if (s_nvk_anim.file == NULL) {
+        LOG(LL_ERROR, ("Animation %s not found", path));
+        return false;
+    }
+    uint8_t h[NVK_ANIM_HEADER_SIZE];
+    if (!nvk_anim_read(h, sizeof(h)) || memcmp(h, "NVKA", 4) != 0 || h[4] != NVK_ANIM_VERSION) {
+        LOG(LL_ERROR, ("Animation %s has a bad header", path));
+        nvk_anim_close();
+        return false;
+    }
+    s_nvk_anim.header.version = h[4];
+    s_nvk_anim.header.flags = h[5];
+    s_nvk_anim.header.pixels = nvk_anim_u16(h + 6);
+    s_nvk_anim.header.frames = nvk_anim_u16(h + 8);
+    s_nvk_anim.header.frame_ms = nvk_anim_u16(h + 10);
+    s_nvk_anim.header.keyframes = nvk_anim_u16(h + 12);
+    if (s_nvk_anim.header.frames == 0 || s_nvk_anim.header.keyframes == 0) {
+        LOG(LL_ERROR, ("Animation %s is empty", path));
+        nvk_anim_close();
+        return false;
+    }
+    LOG(LL_INFO, ("Animation %s: %d pixels, %d frames, %d keyframes", path,
+                  s_nvk_anim.header.pixels, s_nvk_anim.header.frames, s_nvk_anim.header.keyframes));
+    return nvk_anim_seek(0);
+}
+
+const struct nvk_anim_header *nvk_anim_header() {
+    return s_nvk_anim.file != NULL ? &s_nvk_anim.header : NULL;
+}
+
+int nvk_anim_frame() {
+    return s_nvk_anim.frame;
+}
+
+/* Decodes one frame, pixels past the strip are read and dropped */
+static bool nvk_anim_decode() {
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    uint8_t type;
+    if (!nvk_anim_read(&type, 1) || (type != 'K' && type != 'D')) {
+        return false;
+    }
+    int p = 0;
+    while (true) {
+        uint8_t op;
+        if (!nvk_anim_read(&op, 1)) {
+            return false;
+        }
+        int n = (op & 0x3F) + 1;
+        uint8_t rgb[3];
+        switch (op & 0xC0) {
+            case NVK_ANIM_OP_END:
+                s_nvk_anim.frame++;
+                return true;
+            case NVK_ANIM_OP_SKIP:
+                p += n;
+                break;
+            case NVK_ANIM_OP_RUN:
+                if (!nvk_anim_read(rgb, 3)) {
+                    return false;
+                }
+                for (; n > 0; n--, p++) {
+                    if (p < num_pixels) {
+                        node_neopixel_set(p, rgb[0], rgb[1], rgb[2]);
+                    }
+                }
+                break;
+            case NVK_ANIM_OP_LITERAL:
+                for (; n > 0; n--, p++) {
+                    if (!nvk_anim_read(rgb, 3)) {
+                        return false;
+                    }
+                    if (p < num_pixels) {
+                        node_neopixel_set(p, rgb[0], rgb[1], rgb[2]);
+                    }
+                }
+                break;
+        }
+    }
+}
+
+bool nvk_anim_next_frame() {
+    if (s_nvk_anim.file == NULL) {
+        return false;
+    }
+    if (s_nvk_anim.frame >= s_nvk_anim.header.frames) {
+        if (!(s_nvk_anim.header.flags & NVK_ANIM_FLAG_LOOP) || !nvk_anim_seek(0)) {
+            return false;
+        }
+    }
+    return nvk_anim_decode();
+}
+
+/*
+ * Finds the closest keyframe at or before the target in the index, jumps to
+ * it and decodes the deltas in between into the framebuffer.
+ */
+bool nvk_anim_seek(int frame) {
+    if (s_nvk_anim.file == NULL || frame < 0 || frame >= s_nvk_anim.header.frames) {
+        return false;
+    }
+    uint32_t key_frame = 0;
+    uint32_t key_offset = 0;
+    bool found = false;
+    if (!nvk_anim_fseek(NVK_ANIM_HEADER_SIZE)) {
+        return false;
+    }
+    for (int k = 0; k < s_nvk_anim.header.keyframes; k++) {
+        uint8_t e[NVK_ANIM_INDEX_ENTRY_SIZE];
+        if (!nvk_anim_read(e, sizeof(e))) {
+            return false;
+        }
+        uint32_t f = nvk_anim_u32(e);
+        if (f > (uint32_t) frame) {
+            break;
+        }
+        key_frame = f;
+        key_offset = nvk_anim_u32(e + 4);
+        found = true;
+    }
+    if (!found || !nvk_anim_fseek(key_offset)) {
+        LOG(LL_ERROR, ("Animation has no keyframe before %d", frame));
+        return false;
+    }
+    s_nvk_anim.frame = key_frame;
+    while (s_nvk_anim.frame < frame) {
+        if (!nvk_anim_decode()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Driver.AnimSeek {frame: 0}: reposition the open animation */
+void nvk_anim_rpc_seek_handler(struct mg_rpc_request_info *ri, const char *args,
+                               const char *src, void *user_data) {
+    int frame = 0;
+    json_scanf(args, strlen(args), "{frame: %d}", &frame);
+    if (!nvk_anim_seek(frame)) {
+        mg_rpc_send_errorf(ri, -1, "{error: \"No animation open or bad frame\"}");
+        return;
+    }
+    mg_rpc_send_responsef(ri, "{frame:%d,frames:%d,frame_ms:%d}", nvk_anim_frame(),
+                          s_nvk_anim.header.frames, s_nvk_anim.header.frame_ms);
+    (void) src;
+    (void) user_data;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "mgos_adc.h"
+#include "mgos_hw_timers.h"
+#include "mgos_time.h"
+#include "nvk_audio.h"
+
+#define AUDIO_FFT_BITS 6
+#define AUDIO_BINS (NVK_AUDIO_FRAME / 2)
+#define AUDIO_RING (NVK_AUDIO_FRAME * 2) // Power of 2, a block is copied while the timer writes
+#define AUDIO_MAX_RATE 20000
+
+/* sin(2 * pi * k / 64) in Q15, cos(k) = sin(k + 16) */
+static const int16_t AUDIO_SIN_TABLE[NVK_AUDIO_FRAME * 3 / 4] = {
+    0, 3212, 6393, 9512, 12539, 15446, 18204, 20787,
+    23170, 25329, 27245, 28898, 30273, 31356, 32137, 32609,
+    32767, 32609, 32137, 31356, 30273, 28898, 27245, 25329,
+    23170, 20787, 18204, 15446, 12539, 9512, 6393, 3212,
+    0, -3212, -6393, -9512, -12539, -15446, -18204, -20787,
+    -23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609
+};
+
+/* First FFT bin of each band, roughly logarithmic */
+static const uint8_t AUDIO_BAND_EDGES[NVK_AUDIO_BANDS + 1] = { 1, 2, 3, 4, 6, 9, 13, 20, AUDIO_BINS };
+
+static int audio_adc_read(int16_t *buf, int n, void *ctx);
+
+static const struct audio_source s_audio_adc_source = { audio_adc_read, NULL };
+static const struct audio_source *s_audio_source = &s_audio_adc_source;
+
+static int16_t s_audio_re[NVK_AUDIO_FRAME];
+static int16_t s_audio_im[NVK_AUDIO_FRAME];
+static int32_t s_audio_peak = 1 << 8; // Slowly decaying max band energy for auto gain
+static int32_t s_audio_low_avg = 0;
+
+static int16_t s_audio_ring[AUDIO_RING];
+static volatile uint32_t s_audio_head = 0; // Samples written by the timer
+static uint32_t s_audio_tail = 0; // s_audio_head when the last block was taken
+static mgos_timer_id s_audio_timer = MGOS_INVALID_TIMER_ID;
+static int s_audio_pin = 0;
+
+/* 10 bit ADC sampled at effects.audio.rate by a hardware timer */
+static IRAM void audio_adc_isr(void *arg) {
+    s_audio_ring[s_audio_head & (AUDIO_RING - 1)] = (int16_t) ((mgos_adc_read(s_audio_pin) - 512) << 6);
+    s_audio_head++;
+    (void) arg;
+}
+
+/* The newest n samples, none until n new ones arrived since the last block */
+static int audio_adc_read(int16_t *buf, int n, void *ctx) {
+    uint32_t head = s_audio_head;
+    if (s_audio_timer == MGOS_INVALID_TIMER_ID || n > AUDIO_RING || head - s_audio_tail < (uint32_t) n) {
+        return 0;
+    }
+    for (int i = 0; i < n; i++) {
+        buf[i] = s_audio_ring[(head - n + i) & (AUDIO_RING - 1)];
+    }
+    s_audio_tail = head;
+    (void) ctx;
+    return n;
+}
+
+bool audio_start() {
+    if (s_audio_timer != MGOS_INVALID_TIMER_ID) {
+        return true;
+    }
+    int rate = mgos_sys_config_get_effects_audio_rate();
+    if (rate <= 0) {
+        LOG(LL_ERROR, ("Wrong audio rate: %d", rate));
+        return false;
+    }
+    if (rate > AUDIO_MAX_RATE) {
+        rate = AUDIO_MAX_RATE;
+    }
+    s_audio_pin = mgos_sys_config_get_effects_audio_pin();
+    if (!mgos_adc_enable(s_audio_pin)) {
+        LOG(LL_ERROR, ("Audio ADC pin %d not available", s_audio_pin));
+        return false;
+    }
+    s_audio_tail = s_audio_head;
+    s_audio_timer = mgos_set_hw_timer(1000000 / rate, MGOS_TIMER_REPEAT, audio_adc_isr, NULL);
+    return s_audio_timer != MGOS_INVALID_TIMER_ID;
+}
+
+void audio_stop() {
+    if (s_audio_timer != MGOS_INVALID_TIMER_ID) {
+        mgos_clear_timer(s_audio_timer);
+        s_audio_timer = MGOS_INVALID_TIMER_ID;
+    }
+}
+
+void audio_set_source(const struct audio_source *source) {
+    s_audio_source = source != NULL ? source : &s_audio_adc_source;
+}
+
+/* In place radix-2 FFT, every stage scales by 1/2 so Q15 never overflows */
+static void audio_fft(int16_t *re, int16_t *im) {
+    for (int i = 1, j = 0; i < NVK_AUDIO_FRAME; i++) {
+        int bit = NVK_AUDIO_FRAME >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            int16_t t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (int len = 2; len <= NVK_AUDIO_FRAME; len <<= 1) {
+        int step = NVK_AUDIO_FRAME / len;
+        for (int i = 0; i < NVK_AUDIO_FRAME; i += len) {
+            for (int k = 0; k < len / 2; k++) {
+                int32_t wr = AUDIO_SIN_TABLE[k * step + NVK_AUDIO_FRAME / 4];
+                int32_t wi = -AUDIO_SIN_TABLE[k * step];
+                int a = i + k;
+                int b = a + len / 2;
+                int32_t tr = (re[b] * wr - im[b] * wi) >> 15;
+                int32_t ti = (re[b] * wi + im[b] * wr) >> 15;
+                re[b] = (int16_t) ((re[a] - tr) >> 1);
+                im[b] = (int16_t) ((im[a] - ti) >> 1);
+                re[a] = (int16_t) ((re[a] + tr) >> 1);
+                im[a] = (int16_t) ((im[a] + ti) >> 1);
+            }
+        }
+    }
+}
+
+bool audio_process(struct audio_frame *frame) {
+    int64_t start = mgos_uptime_micros();
+    if (s_audio_source->read(s_audio_re, NVK_AUDIO_FRAME, s_audio_source->ctx) < NVK_AUDIO_FRAME) {
+        return false;
+    }
+
+    int32_t mean = 0;
+    for (int i = 0; i < NVK_AUDIO_FRAME; i++) {
+        mean += s_audio_re[i];
+    }
+    mean /= NVK_AUDIO_FRAME;
+    int32_t level = 0;
+    for (int i = 0; i < NVK_AUDIO_FRAME; i++) {
+        s_audio_re[i] -= mean;
+        s_audio_im[i] = 0;
+        level += s_audio_re[i] < 0 ? -s_audio_re[i] : s_audio_re[i];
+    }
+    level /= NVK_AUDIO_FRAME;
+
+    audio_fft(s_audio_re, s_audio_im);
+
+    int32_t energy[NVK_AUDIO_BANDS];
+    int32_t max = 0;
+    for (int b = 0; b < NVK_AUDIO_BANDS; b++) {
+        energy[b] = 0;
+        for (int k = AUDIO_BAND_EDGES[b]; k < AUDIO_BAND_EDGES[b + 1]; k++) {
+            int32_t r = s_audio_re[k] < 0 ? -s_audio_re[k] : s_audio_re[k];
+            int32_t m = s_audio_im[k] < 0 ? -s_audio_im[k] : s_audio_im[k];
+            int32_t mag = r > m ? r + (m >> 1) : m + (r >> 1); // |z| without sqrt
+            if (mag > energy[b]) {
+                energy[b] = mag;
+            }
+        }
+        if (energy[b] > max) {
+            max = energy[b];
+        }
+    }
+
+    s_audio_peak -= s_audio_peak >> 7;
+    if (max > s_audio_peak) {
+        s_audio_peak = max;
+    }
+    if (s_audio_peak < 16) {
+        s_audio_peak = 16;
+    }
+    for (int b = 0; b < NVK_AUDIO_BANDS; b++) {
+        int32_t v = energy[b] * 255 / s_audio_peak;
+        frame->bands[b] = v > 255 ? 255 : (uint8_t) v;
+    }
+    int32_t l = level * 255 / 16384;
+    frame->level = l > 255 ? 255 : (uint8_t) l;
+
+    int32_t low = energy[0] + energy[1];
+    frame->beat = low > 16 && low * 2 > s_audio_low_avg * 3;
+    s_audio_low_avg += (low - s_audio_low_avg) >> 3;
+
+    frame->time_us = (uint32_t) (mgos_uptime_micros() - start);
+    return true;
+}
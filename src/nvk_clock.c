@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "mgos_time.h"
+#include "mgos_rpc.h"
+#include "mgos_mqtt.h"
+#include "frozen.h"
+#include "nvk_sched.h"
+#include "nvk_clock.h"
+
+#define NVK_CLOCK_MAX_ERROR 100000 // us, bigger jumps are outliers
+#define NVK_CLOCK_MAX_OUTLIERS 3 // in a row before starting over
+#define NVK_CLOCK_MAX_DRIFT 500000 // ppb
+#define NVK_CLOCK_STALE_PERIODS 4
+
+const char NVK_CLOCK_JSON_FMT[] = "{t:%lld}";
+
+/* Shared time at local time l is l + offset + drift * (l - ref) */
+struct nvk_clock {
+    bool have;
+    int64_t ref;
+    int64_t offset;
+    int32_t drift; // ppb
+    int64_t last_sample;
+    int samples;
+    int outliers;
+    int total_outliers;
+};
+
+static struct nvk_clock s_nvk_clock = { 0 };
+
+static bool nvk_clock_leader() {
+    return mgos_sys_config_get_app_clock_leader();
+}
+
+static int64_t nvk_clock_shared_us(int64_t local) {
+    if (nvk_clock_leader() || !s_nvk_clock.have) {
+        return local;
+    }
+    return local + s_nvk_clock.offset + s_nvk_clock.drift * (local - s_nvk_clock.ref) / 1000000000;
+}
+
+bool nvk_clock_synced() {
+    if (!mgos_sys_config_get_app_clock_enable()) {
+        return false;
+    }
+    if (nvk_clock_leader()) {
+        return true;
+    }
+    int64_t stale = (int64_t) mgos_sys_config_get_app_clock_interval() * 1000 * NVK_CLOCK_STALE_PERIODS;
+    return s_nvk_clock.have && mgos_uptime_micros() - s_nvk_clock.last_sample < stale;
+}
+
+int64_t nvk_clock_now_ms() {
+    return nvk_clock_shared_us(mgos_uptime_micros()) / 1000;
+}
+
+int32_t nvk_clock_frame(int32_t *counter, int period_ms) {
+    if (!nvk_clock_synced() || period_ms <= 0) {
+        return (*counter)++;
+    }
+    *counter = (int32_t) (nvk_clock_now_ms() / period_ms);
+    return *counter;
+}
+
+/*
+ * Each sample is the leader time seen at a local time. The offset follows a
+ * quarter of the prediction error and the drift a fraction of its slope,
+ * so network jitter is averaged out instead of jumping the phase.
+ */
+static void nvk_clock_sample(int64_t leader, int64_t local) {
+    int64_t measured = leader - local;
+    s_nvk_clock.last_sample = local;
+    s_nvk_clock.samples++;
+    if (!s_nvk_clock.have) {
+        s_nvk_clock.have = true;
+        s_nvk_clock.ref = local;
+        s_nvk_clock.offset = measured;
+        s_nvk_clock.drift = 0;
+        return;
+    }
+    int64_t dt = local - s_nvk_clock.ref;
+    int64_t predicted = s_nvk_clock.offset + s_nvk_clock.drift * dt / 1000000000;
+    int64_t error = measured - predicted;
+    if (error > NVK_CLOCK_MAX_ERROR || error < -NVK_CLOCK_MAX_ERROR) {
+        s_nvk_clock.total_outliers++;
+        if (++s_nvk_clock.outliers >= NVK_CLOCK_MAX_OUTLIERS) {
+            // Leader restarted or changed, take it as it is now
+            s_nvk_clock.have = false;
+            s_nvk_clock.outliers = 0;
+            nvk_clock_sample(leader, local);
+        }
+        return;
+    }
+    s_nvk_clock.outliers = 0;
+    s_nvk_clock.offset = predicted + error / 4;
+    if (dt > 0) {
+        int64_t drift = s_nvk_clock.drift + error * 1000000000 / dt / 16;
+        if (drift > NVK_CLOCK_MAX_DRIFT) {
+            drift = NVK_CLOCK_MAX_DRIFT;
+        } else if (drift < -NVK_CLOCK_MAX_DRIFT) {
+            drift = -NVK_CLOCK_MAX_DRIFT;
+        }
+        s_nvk_clock.drift = (int32_t) drift;
+    }
+    s_nvk_clock.ref = local;
+}
+
+static void nvk_clock_sub_handler(struct mg_connection *nc, const char *topic, int topic_len,
+                                  const char *msg, int msg_len, void *ud) {
+    int64_t local = mgos_uptime_micros();
+    long long leader = -1;
+    if (nvk_clock_leader() || json_scanf(msg, msg_len, NVK_CLOCK_JSON_FMT, &leader) != 1 || leader < 0) {
+        return;
+    }
+    nvk_clock_sample(leader, local);
+    (void) nc;
+    (void) topic;
+    (void) topic_len;
+    (void) ud;
+}
+
+static void nvk_clock_publish(void *arg) {
+    if (nvk_clock_leader()) {
+        mgos_mqtt_pubf(mgos_sys_config_get_app_clock_topic(), 0, false, NVK_CLOCK_JSON_FMT,
+                       (long long) mgos_uptime_micros());
+    }
+    (void) arg;
+}
+
+bool nvk_clock_init() {
+    if (!mgos_sys_config_get_app_clock_enable()) {
+        return false;
+    }
+    mgos_mqtt_sub(mgos_sys_config_get_app_clock_topic(), nvk_clock_sub_handler, NULL);
+    nvk_sched_set(mgos_sys_config_get_app_clock_interval(), true, NVK_SCHED_GROUP_NODES, nvk_clock_publish, NULL);
+    return true;
+}
+
+/* Driver.Clock {period: 20}: compare now_ms and frame across devices */
+void nvk_clock_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args,
+                                const char *src, void *user_data) {
+    int period = 0;
+    json_scanf(args, strlen(args), "{period: %d}", &period);
+    int64_t now = nvk_clock_now_ms();
+    mg_rpc_send_responsef(ri, "{leader:%B,synced:%B,now_ms:%lld,frame:%lld,offset_us:%lld,drift_ppb:%d,"
+                          "samples:%d,outliers:%d}", nvk_clock_leader(), nvk_clock_synced(),
+                          (long long) now, (long long) (period > 0 ? now / period : 0),
+                          (long long) s_nvk_clock.offset, s_nvk_clock.drift,
+                          s_nvk_clock.samples, s_nvk_clock.total_outliers);
+    (void) src;
+    (void) user_data;
+}
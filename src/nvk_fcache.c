@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_fcache.h"
+#include "nvk_clock.h"
+#include "nvk_palette.h"
+
+/*
+ * Frames are encoded as ops covering the strip, one byte with the kind in
+ * the top two bits and length - 1 in the low six:
+ *   RUN n pixels of r, g, b
+ *   GRADIENT n pixels from r, g, b adding signed dr, dg, db per pixel
+ *   LITERAL n pixels, n x r, g, b
+ *   REPEAT the previous frame n times, only at the start of a frame
+ * Gradients make the wheel based effects cheap, repeats the slow ramps.
+ */
+#define FCACHE_OP_RUN 0x00
+#define FCACHE_OP_GRADIENT 0x40
+#define FCACHE_OP_LITERAL 0x80
+#define FCACHE_OP_REPEAT 0xC0
+#define FCACHE_MAX_SPAN 64
+
+enum fcache_state {
+    FCACHE_EMPTY = 0,
+    FCACHE_RECORDING,
+    FCACHE_READY,
+    FCACHE_OFF // Did not fit the budget
+};
+
+struct fcache_key {
+    const struct fcache_effect *effect;
+    int color;
+    int speed;
+    int pixels;
+    uint32_t palettes; // nvk_palette_generation
+};
+
+struct fcache {
+    enum fcache_state state;
+    struct fcache_key key;
+    uint8_t *data;
+    int size;
+    int len;
+    int frames;
+    int last_frame; // Offset and length of the last encoded frame
+    int last_frame_len;
+    int repeat_op; // Offset of the REPEAT op being extended or -1
+    int pos; // Playback
+    int repeat;
+};
+
+static struct fcache s_fcache = { 0 };
+
+void fcache_reset() {
+    free(s_fcache.data);
+    memset(&s_fcache, 0, sizeof(s_fcache));
+}
+
+static bool fcache_put(uint8_t b) {
+    if (s_fcache.len >= s_fcache.size) {
+        return false;
+    }
+    s_fcache.data[s_fcache.len++] = b;
+    return true;
+}
+
+static bool fcache_put_rgb(rgb_color c) {
+    return fcache_put(c.red) && fcache_put(c.green) && fcache_put(c.blue);
+}
+
+static inline bool fcache_same(rgb_color a, rgb_color b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+static inline bool fcache_step(rgb_color a, rgb_color b, int *d) {
+    d[0] = b.red - a.red;
+    d[1] = b.green - a.green;
+    d[2] = b.blue - a.blue;
+    for (int k = 0; k < 3; k++) {
+        if (d[k] < -128 || d[k] > 127) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Length of the RUN (>= 2) or GRADIENT (>= 3) starting at p, 0 if none */
+static int fcache_span(int p, int pixels, int *op, int *d) {
+    rgb_color c = node_neopixel_get_pixel_color(p);
+    int n = 1;
+    while (p + n < pixels && n < FCACHE_MAX_SPAN && fcache_same(c, node_neopixel_get_pixel_color(p + n))) {
+        n++;
+    }
+    if (n >= 2) {
+        *op = FCACHE_OP_RUN;
+        return n;
+    }
+    if (p + 2 >= pixels || !fcache_step(c, node_neopixel_get_pixel_color(p + 1), d)) {
+        return 0;
+    }
+    n = 2;
+    int e[3];
+    while (p + n < pixels && n < FCACHE_MAX_SPAN &&
+           fcache_step(node_neopixel_get_pixel_color(p + n - 1), node_neopixel_get_pixel_color(p + n), e) &&
+           e[0] == d[0] && e[1] == d[1] && e[2] == d[2]) {
+        n++;
+    }
+    if (n < 3) {
+        return 0;
+    }
+    *op = FCACHE_OP_GRADIENT;
+    return n;
+}
+
+static bool fcache_encode(int pixels) {
+    int p = 0;
+    while (p < pixels) {
+        int op;
+        int d[3];
+        int n = fcache_span(p, pixels, &op, d);
+        if (n > 0) {
+            if (!fcache_put(op | (n - 1)) || !fcache_put_rgb(node_neopixel_get_pixel_color(p))) {
+                return false;
+            }
+            if (op == FCACHE_OP_GRADIENT && !(fcache_put(d[0]) && fcache_put(d[1]) && fcache_put(d[2]))) {
+                return false;
+            }
+            p += n;
+            continue;
+        }
+        n = 1;
+        while (p + n < pixels && n < FCACHE_MAX_SPAN && fcache_span(p + n, pixels, &op, d) == 0) {
+            n++;
+        }
+        if (!fcache_put(FCACHE_OP_LITERAL | (n - 1))) {
+            return false;
+        }
+        for (; n > 0; n--, p++) {
+            if (!fcache_put_rgb(node_neopixel_get_pixel_color(p))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Appends the framebuffer, frames equal to the previous one become REPEATs */
+static bool fcache_record(int pixels) {
+    int start = s_fcache.len;
+    if (!fcache_encode(pixels)) {
+        return false;
+    }
+    int len = s_fcache.len - start;
+    if (s_fcache.frames > 0 && len == s_fcache.last_frame_len &&
+        memcmp(s_fcache.data + start, s_fcache.data + s_fcache.last_frame, len) == 0) {
+        s_fcache.len = start;
+        if (s_fcache.repeat_op >= 0 && (s_fcache.data[s_fcache.repeat_op] & 0x3F) < FCACHE_MAX_SPAN - 1) {
+            s_fcache.data[s_fcache.repeat_op]++;
+        } else {
+            s_fcache.repeat_op = s_fcache.len;
+            if (!fcache_put(FCACHE_OP_REPEAT)) {
+                return false;
+            }
+        }
+    } else {
+        s_fcache.last_frame = start;
+        s_fcache.last_frame_len = len;
+        s_fcache.repeat_op = -1;
+    }
+    s_fcache.frames++;
+    return true;
+}
+
+static inline bool fcache_key_equal(const struct fcache_key *a, const struct fcache_key *b) {
+    return a->effect == b->effect && a->color == b->color && a->speed == b->speed && a->pixels == b->pixels &&
+           a->palettes == b->palettes;
+}
+
+static void fcache_play(int pixels) {
+    if (s_fcache.repeat > 0) {
+        s_fcache.repeat--;
+        node_neopixel_show();
+        return;
+    }
+    if (s_fcache.pos >= s_fcache.len) {
+        s_fcache.pos = 0;
+    }
+    const uint8_t *d = s_fcache.data;
+    if ((d[s_fcache.pos] & 0xC0) == FCACHE_OP_REPEAT) {
+        s_fcache.repeat = d[s_fcache.pos++] & 0x3F;
+        node_neopixel_show();
+        return;
+    }
+    int p = 0;
+    while (p < pixels) {
+        uint8_t op = d[s_fcache.pos++];
+        int n = (op & 0x3F) + 1;
+        if ((op & 0xC0) == FCACHE_OP_LITERAL) {
+            for (; n > 0; n--, p++, s_fcache.pos += 3) {
+                node_neopixel_set(p, d[s_fcache.pos], d[s_fcache.pos + 1], d[s_fcache.pos + 2]);
+            }
+            continue;
+        }
+        int r = d[s_fcache.pos];
+        int g = d[s_fcache.pos + 1];
+        int b = d[s_fcache.pos + 2];
+        s_fcache.pos += 3;
+        int dr = 0, dg = 0, db = 0;
+        if ((op & 0xC0) == FCACHE_OP_GRADIENT) {
+            dr = (int8_t) d[s_fcache.pos];
+            dg = (int8_t) d[s_fcache.pos + 1];
+            db = (int8_t) d[s_fcache.pos + 2];
+            s_fcache.pos += 3;
+        }
+        for (; n > 0; n--, p++, r += dr, g += dg, b += db) {
+            node_neopixel_set(p, r, g, b);
+        }
+    }
+    node_neopixel_show();
+}
+
+void fcache_effect(void *arg) {
+    const struct fcache_effect *effect = (const struct fcache_effect *) arg;
+    if (nvk_clock_synced() || node_neopixel_streaming()) {
+        // Frames follow the shared clock, not the call count the cache replays.
+        // A streamed strip has no buffer to record from.
+        effect->render(effect->arg);
+        return;
+    }
+    int budget = mgos_sys_config_get_effects_cache_budget();
+    struct fcache_key key = {
+        effect,
+        mgos_sys_config_get_strip_color(),
+        mgos_sys_config_get_strip_speed(),
+        mgos_sys_config_get_nodes_neopixel_pixels(),
+        nvk_palette_generation()
+    };
+    if (s_fcache.state != FCACHE_EMPTY && !fcache_key_equal(&key, &s_fcache.key)) {
+        fcache_reset();
+    }
+    if (s_fcache.state == FCACHE_EMPTY && budget > 0 && effect->period > 0) {
+        s_fcache.data = (uint8_t *) malloc(budget);
+        s_fcache.state = s_fcache.data != NULL ? FCACHE_RECORDING : FCACHE_OFF;
+        s_fcache.size = budget;
+        s_fcache.key = key;
+        s_fcache.repeat_op = -1;
+    }
+    if (s_fcache.state == FCACHE_READY) {
+        fcache_play(key.pixels);
+        *effect->counter = (*effect->counter + 1) % effect->period;
+        return;
+    }
+    effect->render(effect->arg);
+    if (s_fcache.state != FCACHE_RECORDING) {
+        return;
+    }
+    if (!fcache_record(key.pixels)) {
+        LOG(LL_INFO, ("Frame cache: cycle of %d frames over %d bytes, not cached", effect->period, budget));
+        free(s_fcache.data);
+        s_fcache.data = NULL;
+        s_fcache.state = FCACHE_OFF;
+    } else if (s_fcache.frames == effect->period) {
+        uint8_t *data = (uint8_t *) realloc(s_fcache.data, s_fcache.len);
+        if (data != NULL) {
+            s_fcache.data = data;
+        }
+        s_fcache.state = FCACHE_READY;
+        s_fcache.pos = 0;
+        LOG(LL_INFO, ("Frame cache: %d frames in %d bytes", s_fcache.frames, s_fcache.len));
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include "mgos.h"
+#include "frozen.h"
+#include "nvk_fixed.h"
+
+static volatile uint32_t s_fixed_bench_sink = 0; // Keeps the loops from being optimised away
+
+/* The per-pixel work effects did before: float ramp, divisions and sin() */
+static void fixed_bench_float(int num_pixels, int t) {
+    uint32_t sum = 0;
+    for (int p = 0; p < num_pixels; p++) {
+        int h = (p * 7 + t) & 0xFF;
+        sum += (uint32_t) round((h / 255.0) * 191);
+        sum += h / 10;
+        sum += (h * (255 - p % 256)) / 255;
+        sum += (uint32_t) (128 + 127 * sin(2 * M_PI * ((p + t) & 0xFF) / 256));
+    }
+    s_fixed_bench_sink += sum;
+}
+
+static void fixed_bench_fixed(int num_pixels, int t) {
+    uint32_t sum = 0;
+    for (int p = 0; p < num_pixels; p++) {
+        int h = (p * 7 + t) & 0xFF;
+        sum += fixed_scale8(h, 191);
+        sum += fixed_scale8(h, FIXED_FRAC8(1, 10));
+        sum += fixed_div255(h * (255 - (p & 0xFF)));
+        sum += fixed_sin8(p + t);
+    }
+    s_fixed_bench_sink += sum;
+}
+
+#define FIXED_BENCH_MAX_PIXEL_FRAMES 5000 // The float pass calls sin() per pixel
+
+/*
+ * Driver.MathBench {frames: 50}: us per frame of float against fixed point
+ * pixel math, nothing is shown. frames is capped so that frames times pixels
+ * stays within FIXED_BENCH_MAX_PIXEL_FRAMES.
+ */
+void fixed_rpc_bench_handler(struct mg_rpc_request_info *ri, const char *args,
+                             const char *src, void *user_data) {
+    int frames = 50;
+    json_scanf(args, strlen(args), "{frames: %d}", &frames);
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    int max_frames = FIXED_BENCH_MAX_PIXEL_FRAMES / (num_pixels > 0 ? num_pixels : 1);
+    if (frames <= 0) {
+        frames = 50;
+    }
+    if (frames > max_frames) {
+        frames = max_frames > 0 ? max_frames : 1;
+    }
+
+    int64_t start = mgos_uptime_micros();
+    for (int t = 0; t < frames; t++) {
+        fixed_bench_float(num_pixels, t);
+    }
+    int64_t fp = mgos_uptime_micros() - start;
+    start = mgos_uptime_micros();
+    for (int t = 0; t < frames; t++) {
+        fixed_bench_fixed(num_pixels, t);
+    }
+    int64_t fixed = mgos_uptime_micros() - start;
+
+    mg_rpc_send_responsef(ri, "{pixels:%d,frames:%d,float_us:%d,fixed_us:%d}", num_pixels, frames,
+                          (int) (fp / frames), (int) (fixed / frames));
+    (void) src;
+    (void) user_data;
+}
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include "mgos.h"
+#include "mgos_time.h"
+#include "mgos_rpc.h"
+#include "frozen.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_fixed.h"
+#include "nvk_fxvm.h"
+
+#define FXVM_MAX_SOURCE 256
+#define FXVM_MAX_DEPTH 16 // Nested brackets, calls and signs, each one recurses
+
+enum fxvm_op {
+    FXVM_K = 0, // dst = (int16) (a | b << 8)
+    FXVM_I, FXVM_N, FXVM_T, FXVM_P, // dst = variable, FXVM_P uses a as param index
+    FXVM_ADD, FXVM_SUB, FXVM_MUL, FXVM_DIV, FXVM_MOD,
+    FXVM_AND, FXVM_OR, FXVM_XOR, FXVM_SHL, FXVM_SHR, FXVM_LT, FXVM_GT,
+    FXVM_NEG, FXVM_SIN, FXVM_TRI, FXVM_ABS, FXVM_RND, FXVM_MIN, FXVM_MAX
+};
+
+struct fxvm_parser {
+    const char *src;
+    const char *pos;
+    struct fxvm_program *prog;
+    const char *error;
+    int depth;
+};
+
+static struct fxvm_program s_fxvm_active;
+static bool s_fxvm_loaded = false;
+
+static void fxvm_skip(struct fxvm_parser *p) {
+    while (isspace((unsigned char) *p->pos)) {
+        p->pos++;
+    }
+}
+
+static bool fxvm_fail(struct fxvm_parser *p, const char *error) {
+    if (p->error == NULL) {
+        p->error = error;
+    }
+    return false;
+}
+
+static bool fxvm_emit(struct fxvm_parser *p, int op, int dst, int a, int b) {
+    if (p->prog->len >= FXVM_MAX_CODE) {
+        return fxvm_fail(p, "program too long");
+    }
+    struct fxvm_insn *insn = &p->prog->code[p->prog->len++];
+    insn->op = op;
+    insn->dst = dst;
+    insn->a = a;
+    insn->b = b;
+    return true;
+}
+
+static bool fxvm_expr(struct fxvm_parser *p, int dst);
+
+static bool fxvm_accept(struct fxvm_parser *p, char c) {
+    fxvm_skip(p);
+    if (*p->pos == c) {
+        p->pos++;
+        return true;
+    }
+    return false;
+}
+
+static bool fxvm_call(struct fxvm_parser *p, const char *name, int len, int dst) {
+    static const struct { const char *name; int op; int args; } funcs[] = {
+        { "sin", FXVM_SIN, 1 }, { "tri", FXVM_TRI, 1 }, { "abs", FXVM_ABS, 1 },
+        { "rnd", FXVM_RND, 1 }, { "min", FXVM_MIN, 2 }, { "max", FXVM_MAX, 2 }
+    };
+    for (size_t f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+        if ((int) strlen(funcs[f].name) != len || strncmp(funcs[f].name, name, len) != 0) {
+            continue;
+        }
+        if (dst + funcs[f].args > FXVM_REGS) {
+            return fxvm_fail(p, "expression too deep");
+        }
+        if (!fxvm_expr(p, dst)) {
+            return false;
+        }
+        if (funcs[f].args == 2 && (!fxvm_accept(p, ',') || !fxvm_expr(p, dst + 1))) {
+            return fxvm_fail(p, "expected second argument");
+        }
+        if (!fxvm_accept(p, ')')) {
+            return fxvm_fail(p, "expected )");
+        }
+        return fxvm_emit(p, funcs[f].op, dst, dst, dst + 1);
+    }
+    return fxvm_fail(p, "unknown function");
+}
+
+static bool fxvm_primary(struct fxvm_parser *p, int dst);
+
+static bool fxvm_value(struct fxvm_parser *p, int dst) {
+    fxvm_skip(p);
+    const char *s = p->pos;
+    if (fxvm_accept(p, '(')) {
+        return fxvm_expr(p, dst) && (fxvm_accept(p, ')') || fxvm_fail(p, "expected )"));
+    }
+    if (fxvm_accept(p, '-')) {
+        return fxvm_primary(p, dst) && fxvm_emit(p, FXVM_NEG, dst, dst, 0);
+    }
+    if (isdigit((unsigned char) *s)) {
+        long v = strtol(s, (char **) &p->pos, 0);
+        if (v > 32767) {
+            return fxvm_fail(p, "constant too big");
+        }
+        return fxvm_emit(p, FXVM_K, dst, v & 0xFF, (v >> 8) & 0xFF);
+    }
+    int len = 0;
+    while (isalpha((unsigned char) s[len])) {
+        len++;
+    }
+    if (len == 0) {
+        return fxvm_fail(p, "expected value");
+    }
+    p->pos = s + len;
+    if (fxvm_accept(p, '(')) {
+        return fxvm_call(p, s, len, dst);
+    }
+    if (len == 1) {
+        switch (*s) {
+            case 'i': return fxvm_emit(p, FXVM_I, dst, 0, 0);
+            case 'n': return fxvm_emit(p, FXVM_N, dst, 0, 0);
+            case 't': return fxvm_emit(p, FXVM_T, dst, 0, 0);
+            case 'a': case 'b': case 'c': case 'd':
+                return fxvm_emit(p, FXVM_P, dst, *s - 'a', 0);
+        }
+    }
+    p->pos = s;
+    return fxvm_fail(p, "unknown variable");
+}
+
+static bool fxvm_primary(struct fxvm_parser *p, int dst) {
+    if (p->depth >= FXVM_MAX_DEPTH) {
+        return fxvm_fail(p, "expression too deep");
+    }
+    p->depth++;
+    bool ok = fxvm_value(p, dst);
+    p->depth--;
+    return ok;
+}
+
+/* Binary operators by precedence, lowest first. Two char operators go first */
+static const struct { const char *sym; int op; int level; } FXVM_BINOPS[] = {
+    { "<<", FXVM_SHL, 2 }, { ">>", FXVM_SHR, 2 },
+    { "<", FXVM_LT, 0 }, { ">", FXVM_GT, 0 },
+    { "&", FXVM_AND, 1 }, { "|", FXVM_OR, 1 }, { "^", FXVM_XOR, 1 },
+    { "+", FXVM_ADD, 3 }, { "-", FXVM_SUB, 3 },
+    { "*", FXVM_MUL, 4 }, { "/", FXVM_DIV, 4 }, { "%", FXVM_MOD, 4 }
+};
+#define FXVM_LEVELS 5
+
+static int fxvm_binop(struct fxvm_parser *p, int level) {
+    fxvm_skip(p);
+    for (size_t o = 0; o < sizeof(FXVM_BINOPS) / sizeof(FXVM_BINOPS[0]); o++) {
+        size_t len = strlen(FXVM_BINOPS[o].sym);
+        if (strncmp(p->pos, FXVM_BINOPS[o].sym, len) != 0) {
+            continue;
+        }
+        if (FXVM_BINOPS[o].level != level) {
+            return -1;
+        }
+        p->pos += len;
+        return FXVM_BINOPS[o].op;
+    }
+    return -1;
+}
+
+static bool fxvm_level(struct fxvm_parser *p, int level, int dst) {
+    if (level == FXVM_LEVELS) {
+        return fxvm_primary(p, dst);
+    }
+    if (!fxvm_level(p, level + 1, dst)) {
+        return false;
+    }
+    int op;
+    while ((op = fxvm_binop(p, level)) >= 0) {
+        if (dst + 1 >= FXVM_REGS) {
+            return fxvm_fail(p, "expression too deep");
+        }
+        if (!fxvm_level(p, level + 1, dst + 1) || !fxvm_emit(p, op, dst, dst, dst + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool fxvm_expr(struct fxvm_parser *p, int dst) {
+    return fxvm_level(p, 0, dst);
+}
+
+int fxvm_compile(const char *src, struct fxvm_program *prog, const char **error) {
+    struct fxvm_parser p = { src, src, prog, NULL, 0 };
+    prog->len = 0;
+    prog->outputs = 0;
+    do {
+        if (prog->outputs == 3) {
+            fxvm_fail(&p, "at most three expressions");
+            break;
+        }
+        if (!fxvm_expr(&p, prog->outputs)) {
+            break;
+        }
+        prog->outputs++;
+    } while (fxvm_accept(&p, ';'));
+    fxvm_skip(&p);
+    if (p.error == NULL && *p.pos != '\0') {
+        fxvm_fail(&p, "unexpected character");
+    }
+    if (p.error == NULL && prog->outputs == 2) {
+        fxvm_fail(&p, "expected one or three expressions");
+    }
+    if (error != NULL) {
+        *error = p.error;
+    }
+    return p.error == NULL ? 0 : (int) (p.pos - src) + 1;
+}
+
+static inline int32_t fxvm_tri(int32_t x) {
+    x &= 0xFF;
+    return x < 128 ? x * 2 : 511 - x * 2;
+}
+
+static inline uint8_t fxvm_clamp(int32_t v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+void fxvm_render(const struct fxvm_program *prog, int num_pixels, int32_t t) {
+    int32_t r[FXVM_REGS];
+    const struct fxvm_insn *end = prog->code + prog->len;
+    for (int32_t i = 0; i < num_pixels; i++) {
+        for (const struct fxvm_insn *in = prog->code; in < end; in++) {
+            int32_t *d = &r[in->dst];
+            int32_t y = r[in->b & (FXVM_REGS - 1)];
+            switch (in->op) {
+                case FXVM_K: *d = (int16_t) (in->a | (in->b << 8)); break;
+                case FXVM_I: *d = i; break;
+                case FXVM_N: *d = num_pixels; break;
+                case FXVM_T: *d = t; break;
+                case FXVM_P: *d = prog->params[in->a & (FXVM_PARAMS - 1)]; break;
+                // Overflow wraps instead of being undefined
+                case FXVM_ADD: *d = (int32_t) ((uint32_t) r[in->a] + (uint32_t) y); break;
+                case FXVM_SUB: *d = (int32_t) ((uint32_t) r[in->a] - (uint32_t) y); break;
+                case FXVM_MUL: *d = (int32_t) ((int64_t) r[in->a] * y); break;
+                case FXVM_DIV: *d = y != 0 ? (int32_t) ((int64_t) r[in->a] / y) : 0; break;
+                case FXVM_MOD: *d = y != 0 ? (int32_t) ((int64_t) r[in->a] % y) : 0; break;
+                case FXVM_AND: *d = r[in->a] & y; break;
+                case FXVM_OR: *d = r[in->a] | y; break;
+                case FXVM_XOR: *d = r[in->a] ^ y; break;
+                case FXVM_SHL: *d = (int32_t) ((uint32_t) r[in->a] << (y & 31)); break;
+                case FXVM_SHR: *d = r[in->a] >> (y & 31); break;
+                case FXVM_LT: *d = r[in->a] < y; break;
+                case FXVM_GT: *d = r[in->a] > y; break;
+                case FXVM_NEG: *d = (int32_t) (0u - (uint32_t) r[in->a]); break;
+                case FXVM_SIN: *d = fixed_sin8((uint8_t) r[in->a]); break;
+                case FXVM_TRI: *d = fxvm_tri(r[in->a]); break;
+                case FXVM_ABS: *d = r[in->a] < 0 ? (int32_t) (0u - (uint32_t) r[in->a]) : r[in->a]; break;
+                case FXVM_RND: *d = r[in->a] > 0 ? (int32_t) mgos_rand_range(0, r[in->a]) : 0; break;
+                case FXVM_MIN: *d = r[in->a] < y ? r[in->a] : y; break;
+                case FXVM_MAX: *d = r[in->a] > y ? r[in->a] : y; break;
+            }
+        }
+        if (prog->outputs == 3) {
+            node_neopixel_set(i, fxvm_clamp(r[0]), fxvm_clamp(r[1]), fxvm_clamp(r[2]));
+        } else {
+            // Same three segment hue as the rainbow effects
+            int h = r[0] & 0xFF;
+            if (h < 85) {
+                node_neopixel_set(i, 255 - h * 3, h * 3, 0);
+            } else if (h < 170) {
+                h -= 85;
+                node_neopixel_set(i, 0, 255 - h * 3, h * 3);
+            } else {
+                h -= 170;
+                node_neopixel_set(i, h * 3, 0, 255 - h * 3);
+            }
+        }
+    }
+}
+
+struct fxvm_program *fxvm_active() {
+    return s_fxvm_loaded ? &s_fxvm_active : NULL;
+}
+
+/* Parses {src: "...", a: 0, b: 0, c: 0, d: 0} into prog */
+static int fxvm_compile_json(const char *json, struct fxvm_program *prog, const char **error) {
+    char *src = NULL;
+    int32_t *params = prog->params;
+    memset(params, 0, sizeof(prog->params));
+    json_scanf(json, strlen(json), "{src: %Q, a: %d, b: %d, c: %d, d: %d}",
+               &src, &params[0], &params[1], &params[2], &params[3]);
+    if (src == NULL || strlen(src) > FXVM_MAX_SOURCE) {
+        free(src);
+        *error = "missing or too long src";
+        return 1;
+    }
+    int pos = fxvm_compile(src, prog, error);
+    free(src);
+    return pos;
+}
+
+bool fxvm_load() {
+    char *json = json_fread(mgos_sys_config_get_effects_program_file());
+    if (json == NULL) {
+        return false;
+    }
+    const char *error = NULL;
+    int pos = fxvm_compile_json(json, &s_fxvm_active, &error);
+    free(json);
+    if (pos != 0) {
+        LOG(LL_ERROR, ("Effect program error at %d: %s", pos, error));
+    }
+    s_fxvm_loaded = pos == 0;
+    return s_fxvm_loaded;
+}
+
+/* Driver.Program {src: "...", a: 1}: compile, store on fs and make active */
+void fxvm_rpc_upload_handler(struct mg_rpc_request_info *ri, const char *args,
+                           const char *src, void *user_data) {
+    struct fxvm_program prog;
+    const char *error = NULL;
+    int pos = fxvm_compile_json(args, &prog, &error);
+    if (pos != 0) {
+        mg_rpc_send_errorf(ri, -1, "{error: %Q, pos: %d}", error, pos);
+        return;
+    }
+    FILE *f = fopen(mgos_sys_config_get_effects_program_file(), "w");
+    if (f == NULL || fwrite(args, 1, strlen(args), f) != strlen(args)) {
+        if (f != NULL) {
+            fclose(f);
+        }
+        mg_rpc_send_errorf(ri, -1, "{error: \"Failed to store the program\"}");
+        return;
+    }
+    fclose(f);
+    s_fxvm_active = prog;
+    s_fxvm_loaded = true;
+    mg_rpc_send_responsef(ri, "{success:true,insns:%d,outputs:%d}", prog.len, prog.outputs);
+    (void) src;
+    (void) user_data;
+}
+
+/* Native equivalent of "i * 256 / n + t" as hue, to compare with the VM */
+static void fxvm_bench_native(int num_pixels, int32_t t) {
+    for (int i = 0; i < num_pixels; i++) {
+        int h = (i * 256 / num_pixels + t) & 0xFF;
+        if (h < 85) {
+            node_neopixel_set(i, 255 - h * 3, h * 3, 0);
+        } else if (h < 170) {
+            h -= 85;
+            node_neopixel_set(i, 0, 255 - h * 3, h * 3);
+        } else {
+            h -= 170;
+            node_neopixel_set(i, h * 3, 0, 255 - h * 3);
+        }
+    }
+}
+
+#define FXVM_BENCH_MAX_PIXEL_FRAMES 20000
+
+/*
+ * Driver.ProgramBench {frames: 50}: us per frame of the VM against native
+ * code. Both draw into the strip buffer without showing it and the running
+ * effect's frame is put back afterwards. frames is capped so that frames
+ * times pixels stays within FXVM_BENCH_MAX_PIXEL_FRAMES.
+ */
+void fxvm_rpc_bench_handler(struct mg_rpc_request_info *ri, const char *args,
+                           const char *src, void *user_data) {
+    int frames = 50;
+    json_scanf(args, strlen(args), "{frames: %d}", &frames);
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    int max_frames = FXVM_BENCH_MAX_PIXEL_FRAMES / (num_pixels > 0 ? num_pixels : 1);
+    if (frames <= 0) {
+        frames = 50;
+    }
+    if (frames > max_frames) {
+        frames = max_frames > 0 ? max_frames : 1;
+    }
+    uint8_t *frame = node_neopixel_frame_save();
+    if (frame == NULL) {
+        mg_rpc_send_errorf(ri, -1, "{error: \"No frame buffer to keep\"}");
+        return;
+    }
+    struct fxvm_program prog;
+    fxvm_compile("i * 256 / n + t", &prog, NULL);
+
+    int64_t start = mgos_uptime_micros();
+    for (int t = 0; t < frames; t++) {
+        fxvm_render(&prog, num_pixels, t);
+    }
+    int64_t vm = mgos_uptime_micros() - start;
+    start = mgos_uptime_micros();
+    for (int t = 0; t < frames; t++) {
+        fxvm_bench_native(num_pixels, t);
+    }
+    int64_t native = mgos_uptime_micros() - start;
+    node_neopixel_frame_restore(frame);
+
+    mg_rpc_send_responsef(ri, "{pixels:%d,frames:%d,vm_us:%d,native_us:%d}", num_pixels, frames,
+                          (int) (vm / frames), (int) (native / frames));
+    (void) src;
+    (void) user_data;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "mgos_http_server.h"
+#include "frozen.h"
+#include "nvk_sched.h"
+#include "nvk_live.h"
+
+struct nvk_live_field_def {
+    const char *name;
+    int deadband; // Changes smaller than this are not pushed
+    int hold_ms; // Changes closer than this to the last one wait for its end
+};
+
+static const struct nvk_live_field_def NVK_LIVE_FIELD_DEFS[NVK_LIVE_FIELDS] = {
+    { "mode", 0, 0 }, { "effect", 0, 0 }, { "color", 0, 0 }, { "temp", 0, 0 },
+    { "humd", 0, 0 }, { "lum", 8, 0 }, { "pir", 0, 0 }, { "brightness", 0, 0 },
+    { "last_motion", 0, 0 }, { "power", 50, 1000 }, { "power_limit", 0, 1000 },
+    { "dht_valid", 0, 0 }
+};
+
+static int s_nvk_live_values[NVK_LIVE_FIELDS] = { [NVK_LIVE_POWER_LIMIT] = 100 };
+static uint32_t s_nvk_live_dirty = 0;
+static uint32_t s_nvk_live_version = 1;
+static nvk_sched_id s_nvk_live_flush_id = NVK_SCHED_INVALID_ID;
+static int64_t s_nvk_live_changed_ms[NVK_LIVE_FIELDS]; // Last published change
+static uint32_t s_nvk_live_held = 0;
+static nvk_sched_id s_nvk_live_hold_id = NVK_SCHED_INVALID_ID;
+static struct mg_connection *s_nvk_live_clients[NVK_LIVE_MAX_CLIENTS];
+
+/* Writes {field: value, ...} for the fields in mask */
+static int nvk_live_format(char *buf, int size, uint32_t mask) {
+    struct json_out out = JSON_OUT_BUF(buf, size);
+    int len = json_printf(&out, "{");
+    bool first = true;
+    for (int f = 0; f < NVK_LIVE_FIELDS; f++) {
+        if (!(mask & (1 << f))) {
+            continue;
+        }
+        if (!first) {
+            len += json_printf(&out, ",");
+        }
+        len += json_printf(&out, "%Q:%d", NVK_LIVE_FIELD_DEFS[f].name, s_nvk_live_values[f]);
+        first = false;
+    }
+    len += json_printf(&out, "}");
+    return len < size ? len : size - 1;
+}
+
+static void nvk_live_send(struct mg_connection *nc, uint32_t mask) {
+    char buf[160];
+    int len = nvk_live_format(buf, sizeof(buf), mask);
+    mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, buf, len);
+}
+
+static void nvk_live_flush(void *arg) {
+    s_nvk_live_flush_id = NVK_SCHED_INVALID_ID;
+    uint32_t dirty = s_nvk_live_dirty;
+    s_nvk_live_dirty = 0;
+    for (int c = 0; c < NVK_LIVE_MAX_CLIENTS; c++) {
+        if (s_nvk_live_clients[c] != NULL) {
+            nvk_live_send(s_nvk_live_clients[c], dirty);
+        }
+    }
+    (void) arg;
+}
+
+static void nvk_live_publish(uint32_t mask) {
+    int64_t now = mgos_uptime_micros() / 1000;
+    for (int f = 0; f < NVK_LIVE_FIELDS; f++) {
+        if (mask & (1 << f)) {
+            s_nvk_live_changed_ms[f] = now;
+        }
+    }
+    s_nvk_live_held &= ~mask;
+    s_nvk_live_version++;
+    s_nvk_live_dirty |= mask;
+    if (s_nvk_live_flush_id == NVK_SCHED_INVALID_ID) {
+        s_nvk_live_flush_id = nvk_sched_set(mgos_sys_config_get_app_live_coalesce(), false,
+                                            NVK_SCHED_GROUP_NODES, nvk_live_flush, NULL);
+    }
+}
+
+/* Held fields are published together, with one version bump */
+static void nvk_live_release(void *arg) {
+    s_nvk_live_hold_id = NVK_SCHED_INVALID_ID;
+    if (s_nvk_live_held != 0) {
+        nvk_live_publish(s_nvk_live_held);
+    }
+    (void) arg;
+}
+
+void nvk_live_set(enum nvk_live_field field, int value) {
+    int diff = value - s_nvk_live_values[field];
+    if (diff == 0 || (diff < 0 ? -diff : diff) < NVK_LIVE_FIELD_DEFS[field].deadband) {
+        return;
+    }
+    s_nvk_live_values[field] = value;
+    int hold_ms = NVK_LIVE_FIELD_DEFS[field].hold_ms;
+    int64_t wait = s_nvk_live_changed_ms[field] + hold_ms - mgos_uptime_micros() / 1000;
+    if (hold_ms > 0 && wait > 0) {
+        // Fields set every frame (power) bump the version at most once per hold
+        s_nvk_live_held |= 1 << field;
+        if (s_nvk_live_hold_id == NVK_SCHED_INVALID_ID) {
+            s_nvk_live_hold_id = nvk_sched_set((int) wait, false, NVK_SCHED_GROUP_NODES, nvk_live_release, NULL);
+        }
+        return;
+    }
+    nvk_live_publish(1 << field);
+}
+
+int nvk_live_get(enum nvk_live_field field) {
+    return s_nvk_live_values[field];
+}
+
+uint32_t nvk_live_version() {
+    return s_nvk_live_version;
+}
+
+static void nvk_live_handler(struct mg_connection *nc, int ev, void *ev_data, void *user_data) {
+    switch (ev) {
+        case MG_EV_WEBSOCKET_HANDSHAKE_DONE:
+            for (int c = 0; c < NVK_LIVE_MAX_CLIENTS; c++) {
+                if (s_nvk_live_clients[c] == NULL) {
+                    s_nvk_live_clients[c] = nc;
+                    nvk_live_send(nc, (1 << NVK_LIVE_FIELDS) - 1);
+                    return;
+                }
+            }
+            LOG(LL_WARN, ("Live state: too many clients"));
+            nc->flags |= MG_F_SEND_AND_CLOSE;
+            break;
+        case MG_EV_CLOSE:
+            for (int c = 0; c < NVK_LIVE_MAX_CLIENTS; c++) {
+                if (s_nvk_live_clients[c] == nc) {
+                    s_nvk_live_clients[c] = NULL;
+                }
+            }
+            break;
+    }
+    (void) ev_data;
+    (void) user_data;
+}
+
+bool nvk_live_init() {
+    if (!mgos_sys_config_get_app_live_enable()) {
+        return false;
+    }
+    return mgos_register_http_endpoint("/live", nvk_live_handler, NULL);
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "mgos_time.h"
+#include "mgos_rpc.h"
+#include "frozen.h"
+#include "nvk_log.h"
+
+#define NVK_LOG_LINE_SIZE 96
+#define NVK_LOG_DRAIN_LIMIT 32
+
+struct nvk_log_record {
+    uint32_t time; // Uptime (ms)
+    uint8_t module;
+    int8_t level;
+    uint16_t msg;
+    int32_t args[3];
+};
+
+int8_t g_nvk_log_levels[NVK_LOG_MODULES];
+
+static struct nvk_log_record s_nvk_log_ring[NVK_LOG_RING_SIZE];
+static int s_nvk_log_head = 0;
+static int s_nvk_log_len = 0;
+static int s_nvk_log_dropped = 0;
+
+static const char *NVK_LOG_MODULE_NAMES[NVK_LOG_MODULES] = {
+    "driver", "pir", "dht", "photoresistor", "neopixel"
+};
+
+#define NVK_LOG_MSG_FMT(id, named, fmt) fmt,
+static const char *NVK_LOG_MSG_FMTS[NVK_LOG_MSG_COUNT] = {
+    NVK_LOG_MESSAGES(NVK_LOG_MSG_FMT)
+};
+#undef NVK_LOG_MSG_FMT
+
+#define NVK_LOG_MSG_NAMED(id, named, fmt) named,
+static const bool NVK_LOG_MSG_NAMED[NVK_LOG_MSG_COUNT] = {
+    NVK_LOG_MESSAGES(NVK_LOG_MSG_NAMED)
+};
+#undef NVK_LOG_MSG_NAMED
+
+static nvk_log_name_fn s_nvk_log_name_lookups[NVK_LOG_MSG_COUNT];
+
+void nvk_log_set_name_lookup(enum nvk_log_msg msg, nvk_log_name_fn lookup) {
+    s_nvk_log_name_lookups[msg] = lookup;
+}
+
+static int nvk_log_format(const struct nvk_log_record *r, char *buf, size_t size) {
+    int n = snprintf(buf, size, "[%u.%03u] %s: ", (unsigned) (r->time / 1000), (unsigned) (r->time % 1000),
+                     NVK_LOG_MODULE_NAMES[r->module]);
+    if (n < 0 || (size_t) n >= size) {
+        return n;
+    }
+    if (NVK_LOG_MSG_NAMED[r->msg]) {
+        nvk_log_name_fn lookup = s_nvk_log_name_lookups[r->msg];
+        const char *name = lookup != NULL ? lookup(r->args[0]) : NULL;
+        return n + snprintf(buf + n, size - n, NVK_LOG_MSG_FMTS[r->msg], name != NULL ? name : "?",
+                            (int) r->args[0], (int) r->args[1], (int) r->args[2]);
+    }
+    return n + snprintf(buf + n, size - n, NVK_LOG_MSG_FMTS[r->msg], (int) r->args[0], (int) r->args[1], (int) r->args[2]);
+}
+
+static void nvk_log_echo(const struct nvk_log_record *r) {
+    char line[NVK_LOG_LINE_SIZE];
+    nvk_log_format(r, line, sizeof(line));
+    LOG(r->level, ("%s", line));
+}
+
+void nvk_log_write(enum nvk_log_module module, int level, enum nvk_log_msg msg, int32_t a0, int32_t a1, int32_t a2) {
+    int tail = (s_nvk_log_head + s_nvk_log_len) % NVK_LOG_RING_SIZE;
+    struct nvk_log_record *r = &s_nvk_log_ring[tail];
+    if (s_nvk_log_len == NVK_LOG_RING_SIZE) {
+        s_nvk_log_head = (s_nvk_log_head + 1) % NVK_LOG_RING_SIZE;
+        s_nvk_log_dropped++;
+    } else {
+        s_nvk_log_len++;
+    }
+    r->time = (uint32_t) (mgos_uptime_micros() / 1000);
+    r->module = module;
+    r->level = level;
+    r->msg = msg;
+    r->args[0] = a0;
+    r->args[1] = a1;
+    r->args[2] = a2;
+    if (mgos_sys_config_get_app_log_echo()) {
+        nvk_log_echo(r);
+    }
+}
+
+static struct nvk_log_record *nvk_log_pop() {
+    if (s_nvk_log_len == 0) {
+        return NULL;
+    }
+    struct nvk_log_record *r = &s_nvk_log_ring[s_nvk_log_head];
+    s_nvk_log_head = (s_nvk_log_head + 1) % NVK_LOG_RING_SIZE;
+    s_nvk_log_len--;
+    return r;
+}
+
+int nvk_log_flush() {
+    int n = 0;
+    struct nvk_log_record *r;
+    while ((r = nvk_log_pop()) != NULL) {
+        nvk_log_echo(r);
+        n++;
+    }
+    return n;
+}
+
+bool nvk_log_set_level(const char *module, int level) {
+    for (int m = 0; m < NVK_LOG_MODULES; m++) {
+        if (module == NULL || strcmp(module, NVK_LOG_MODULE_NAMES[m]) == 0) {
+            g_nvk_log_levels[m] = level;
+            if (module != NULL) {
+                return true;
+            }
+        }
+    }
+    return module == NULL;
+}
+
+static int nvk_log_json_lines(struct json_out *out, va_list *ap) {
+    int limit = va_arg(*ap, int);
+    char line[NVK_LOG_LINE_SIZE];
+    int len = 0;
+    struct nvk_log_record *r;
+    for (int i = 0; i < limit && (r = nvk_log_pop()) != NULL; i++) {
+        nvk_log_format(r, line, sizeof(line));
+        if (i > 0) {
+            len += json_printf(out, ",");
+        }
+        len += json_printf(out, "%Q", line);
+    }
+    return len;
+}
+
+/* Driver.Log {limit: 32, uart: false}: drain formatted records as JSON, or to the UART log */
+void nvk_log_rpc_drain_handler(struct mg_rpc_request_info *ri, const char *args,
+                           const char *src, void *user_data) {
+    int limit = NVK_LOG_DRAIN_LIMIT;
+    bool uart = false;
+    json_scanf(args, strlen(args), "{limit: %d, uart: %B}", &limit, &uart);
+    int dropped = s_nvk_log_dropped;
+    s_nvk_log_dropped = 0;
+    if (uart) {
+        mg_rpc_send_responsef(ri, "{dropped:%d,flushed:%d}", dropped, nvk_log_flush());
+    } else {
+        if (limit <= 0 || limit > NVK_LOG_DRAIN_LIMIT) {
+            limit = NVK_LOG_DRAIN_LIMIT;
+        }
+        mg_rpc_send_responsef(ri, "{dropped:%d,lines:[%M],pending:%d}", dropped, nvk_log_json_lines, limit, s_nvk_log_len);
+    }
+    (void) src;
+    (void) user_data;
+}
+
+/* Driver.LogLevel {module: "dht", level: 3}, without module it applies to all */
+void nvk_log_rpc_level_handler(struct mg_rpc_request_info *ri, const char *args,
+                           const char *src, void *user_data) {
+    char *module = NULL;
+    int level = -2;
+    json_scanf(args, strlen(args), "{module: %Q, level: %d}", &module, &level);
+    if (level < LL_NONE || level > LL_VERBOSE_DEBUG || !nvk_log_set_level(module, level)) {
+        mg_rpc_send_errorf(ri, -1, "{error: \"Bad module or level\"}");
+    } else {
+        mg_rpc_send_responsef(ri, "{success:true}");
+    }
+    free(module);
+    (void) src;
+    (void) user_data;
+}
+
+bool nvk_log_init() {
+    nvk_log_set_level(NULL, mgos_sys_config_get_app_log_level());
+    return true;
+}
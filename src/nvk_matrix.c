@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "frozen.h"
+#include "nvk_matrix.h"
+
+static uint16_t *s_nvk_matrix_xy = NULL; // width x height physical pixels, row by row
+static int s_nvk_matrix_width = 0;
+static int s_nvk_matrix_height = 0;
+
+int nvk_matrix_width() {
+    return s_nvk_matrix_width;
+}
+
+int nvk_matrix_height() {
+    return s_nvk_matrix_height;
+}
+
+int nvk_matrix_xy(int x, int y) {
+    if (x < 0 || y < 0 || x >= s_nvk_matrix_width || y >= s_nvk_matrix_height) {
+        return -1;
+    }
+    uint16_t p = s_nvk_matrix_xy[y * s_nvk_matrix_width + x];
+    return p == NVK_MATRIX_NONE ? -1 : p;
+}
+
+/* Clips the rectangle to the panel, false when nothing is left */
+static bool nvk_matrix_clip(int *x, int *y, int *w, int *h, int *sx, int *sy) {
+    *sx = *x < 0 ? -*x : 0;
+    *sy = *y < 0 ? -*y : 0;
+    *x += *sx;
+    *y += *sy;
+    *w -= *sx;
+    *h -= *sy;
+    if (*x + *w > s_nvk_matrix_width) {
+        *w = s_nvk_matrix_width - *x;
+    }
+    if (*y + *h > s_nvk_matrix_height) {
+        *h = s_nvk_matrix_height - *y;
+    }
+    return *w > 0 && *h > 0;
+}
+
+void nvk_matrix_fill(int x, int y, int w, int h, rgb_color c) {
+    int sx, sy;
+    if (!nvk_matrix_clip(&x, &y, &w, &h, &sx, &sy)) {
+        return;
+    }
+    for (int j = 0; j < h; j++) {
+        const uint16_t *row = s_nvk_matrix_xy + (y + j) * s_nvk_matrix_width + x;
+        for (int i = 0; i < w; i++) {
+            node_neopixel_set(row[i], c.red, c.green, c.blue); // Holes fall out of range
+        }
+    }
+}
+
+void nvk_matrix_blit(int x, int y, int w, int h, const rgb_color *src) {
+    int stride = w;
+    int sx, sy;
+    if (!nvk_matrix_clip(&x, &y, &w, &h, &sx, &sy)) {
+        return;
+    }
+    for (int j = 0; j < h; j++) {
+        const uint16_t *row = s_nvk_matrix_xy + (y + j) * s_nvk_matrix_width + x;
+        const rgb_color *s = src + (sy + j) * stride + sx;
+        for (int i = 0; i < w; i++) {
+            node_neopixel_set(row[i], s[i].red, s[i].green, s[i].blue);
+        }
+    }
+}
+
+void nvk_matrix_scroll(int dx, int dy, rgb_color fill) {
+    int width = s_nvk_matrix_width;
+    int height = s_nvk_matrix_height;
+    // Walk against the move so every pixel is read before it is overwritten
+    int j0 = dy > 0 ? height - 1 : 0, jstep = dy > 0 ? -1 : 1;
+    int i0 = dx > 0 ? width - 1 : 0, istep = dx > 0 ? -1 : 1;
+    for (int j = j0; j >= 0 && j < height; j += jstep) {
+        const uint16_t *row = s_nvk_matrix_xy + j * width;
+        int from_y = j - dy;
+        const uint16_t *from = from_y >= 0 && from_y < height ? s_nvk_matrix_xy + from_y * width : NULL;
+        for (int i = i0; i >= 0 && i < width; i += istep) {
+            int from_x = i - dx;
+            rgb_color c = fill;
+            if (from != NULL && from_x >= 0 && from_x < width && from[from_x] != NVK_MATRIX_NONE) {
+                c = node_neopixel_get_pixel_color(from[from_x]);
+            }
+            node_neopixel_set(row[i], c.red, c.green, c.blue);
+        }
+    }
+}
+
+static bool nvk_matrix_load_custom(int cells, int pixels) {
+    const char *file = mgos_sys_config_get_nodes_neopixel_matrix_file();
+    char *json = json_fread(file);
+    if (json == NULL) {
+        LOG(LL_ERROR, ("Matrix map %s not found", file ? file : ""));
+        return false;
+    }
+    int len = strlen(json);
+    struct json_token t;
+    int c = 0;
+    for (; c < cells && json_scanf_array_elem(json, len, ".map", c, &t) > 0; c++) {
+        long p = strtol(t.ptr, NULL, 10);
+        s_nvk_matrix_xy[c] = p >= 0 && p < pixels ? (uint16_t) p : NVK_MATRIX_NONE;
+    }
+    free(json);
+    if (c != cells) {
+        LOG(LL_ERROR, ("Matrix map %s has %d of %d cells", file, c, cells));
+        return false;
+    }
+    return true;
+}
+
+bool nvk_matrix_init() {
+    int width = mgos_sys_config_get_nodes_neopixel_matrix_width();
+    int height = mgos_sys_config_get_nodes_neopixel_matrix_height();
+    int pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    if (width <= 0 || height <= 0) {
+        return true;
+    }
+    s_nvk_matrix_xy = (uint16_t *) malloc(width * height * sizeof(uint16_t));
+    if (s_nvk_matrix_xy == NULL) {
+        return false;
+    }
+    const char *layout = mgos_sys_config_get_nodes_neopixel_matrix_layout();
+    if (layout != NULL && strcmp(layout, "custom") == 0) {
+        if (!nvk_matrix_load_custom(width * height, pixels)) {
+            free(s_nvk_matrix_xy);
+            s_nvk_matrix_xy = NULL;
+            return false;
+        }
+    } else {
+        bool serpentine = layout == NULL || strcmp(layout, "zigzag") != 0;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int p = y * width + (serpentine && (y & 1) ? width - 1 - x : x);
+                s_nvk_matrix_xy[y * width + x] = p < pixels ? (uint16_t) p : NVK_MATRIX_NONE;
+            }
+        }
+    }
+    s_nvk_matrix_width = width;
+    s_nvk_matrix_height = height;
+    return true;
+}
@@ -17,12 +17,84 @@
 
 #include <stdbool.h>
 #include "mgos.h"
+#include "mgos_time.h"
 #include "nvk_nodes.h"
 #include "nvk_nodes_dht.h"
 #include "nvk_nodes_pir.h"
 #include "nvk_nodes_photoresistor.h"
 #include "nvk_nodes_neopixel.h"
 
+void node_range_threshold_init(struct node_range_threshold *t, int hysteresis, int dwell, int interval, void *user_data) {
+    t->hysteresis = hysteresis;
+    t->dwell = dwell;
+    t->interval = interval;
+    t->state = NODE_RANGE_UNKNOWN;
+    t->pending = NODE_RANGE_UNKNOWN;
+    t->pending_since = 0;
+    t->last_event = 0;
+    t->user_data = user_data;
+}
+
+static int node_range_threshold_classify(struct node_range_threshold *t, int current) {
+    int min = t->values.min;
+    int max = t->values.max;
+    switch (t->state) {
+        case ABOVE_OF_RANGE:
+            if (current > max - t->hysteresis) {
+                return ABOVE_OF_RANGE;
+            }
+            break;
+        case BELOW_OF_RANGE:
+            if (current < min + t->hysteresis) {
+                return BELOW_OF_RANGE;
+            }
+            break;
+    }
+    if (current > max) {
+        return ABOVE_OF_RANGE;
+    }
+    if (current < min) {
+        return BELOW_OF_RANGE;
+    }
+    return NODE_RANGE_ON;
+}
+
+bool node_range_threshold_update(struct node_range_threshold *t, int current, int min, int max) {
+    t->values.current = current;
+    t->values.min = min;
+    t->values.max = max;
+
+    int state = node_range_threshold_classify(t, current);
+    if (state == t->state) {
+        t->pending = NODE_RANGE_UNKNOWN;
+        return false;
+    }
+
+    double now = mgos_uptime();
+    if (state != t->pending) {
+        t->pending = state;
+        t->pending_since = now;
+    }
+    if ((now - t->pending_since) * 1000 < t->dwell) {
+        return false;
+    }
+    if (t->state != NODE_RANGE_UNKNOWN && (now - t->last_event) * 1000 < t->interval) {
+        return false;
+    }
+
+    t->state = state;
+    t->pending = NODE_RANGE_UNKNOWN;
+    t->last_event = now;
+    if (state == NODE_RANGE_ON) {
+        if (t->on_range != NULL) {
+            t->on_range(&t->values, t->user_data);
+        }
+    } else if (t->out_range != NULL) {
+        t->out_range(state, &t->values, t->user_data);
+    }
+    return true;
+}
+
 /* Initialize Nodes */
 bool mgos_nodes_init() {
     node_dht_init(); // TODO
@@ -17,38 +17,51 @@
 
 #include "mgos.h"
 #include "nvk_nodes.h"
+#include "nvk_sched.h"
 #include "nvk_nodes_dht.h"
 #include "mgos_time.h"
 #include "mgos_dht.h"
 #include "mgos_mqtt.h"
 #include "mgos_rpc.h"
+#include "nvk_log.h"
+#include "nvk_live.h"
 
 static struct mgos_dht *s_node_dht = NULL;
-static node_on_range_handler_t s_node_temp_on_range_handler = NULL;
-static node_out_range_handler_t s_node_temp_out_range_handler = NULL;
-static node_on_range_handler_t s_node_humd_on_range_handler = NULL;
-static node_out_range_handler_t s_node_humd_out_range_handler = NULL;
+static struct node_range_threshold s_node_temp_range = { .state = NODE_RANGE_UNKNOWN };
+static struct node_range_threshold s_node_humd_range = { .state = NODE_RANGE_UNKNOWN };
+
+/* Last good reading, the sampling timer is the only one talking to the sensor */
+struct node_dht_sample {
+    float temp;
+    float humd;
+    double time; // Uptime of the reading (s), 0 if never read
+    int errors; // Consecutive failed reads
+    int total_errors;
+};
+
+static struct node_dht_sample s_node_dht_sample = { NAN, NAN, 0, 0, 0 };
 
 const char DHT_TELE_JSON_FMT[] = "{dht:{temperature:%d,humidity:%d,uptime:%f}}";
+const char DHT_RPC_STAT_JSON_FMT[] = "{dht:{temperature:%d,humidity:%d,uptime:%f,age:%d,errors:%d}}";
 const char DHT_RPC_STAT_METHOD_NAME[] = "Nodes.DHT.Stat";
 
-static mgos_timer_id node_dht_samp_int_timer_id = MGOS_INVALID_TIMER_ID;
-static mgos_timer_id node_dht_tele_int_timer_id = MGOS_INVALID_TIMER_ID;
+static nvk_sched_id node_dht_samp_int_timer_id = NVK_SCHED_INVALID_ID;
+static nvk_sched_id node_dht_tele_int_timer_id = NVK_SCHED_INVALID_ID;
 
 void node_dht_set_temp_on_range_handler(node_on_range_handler_t func) {
-    s_node_temp_on_range_handler = func;
+    s_node_temp_range.on_range = func;
 }
 
 void node_dht_set_temp_out_range_handler(node_out_range_handler_t func) {
-    s_node_temp_out_range_handler = func;
+    s_node_temp_range.out_range = func;
 }
 
 void node_dht_set_humd_on_range_handler(node_on_range_handler_t func) {
-    s_node_humd_on_range_handler = func;
+    s_node_humd_range.on_range = func;
 }
 
 void node_dht_set_humd_out_range_handler(node_out_range_handler_t func) {
-    s_node_humd_out_range_handler = func;
+    s_node_humd_range.out_range = func;
 }
 
 void default_node_dht_on_range_handler(struct node_range_values *values, void *user_data) {
@@ -66,85 +79,102 @@ void default_node_dht_out_range_handler(enum node_out_range_event_type ev, struc
     }
 }
 
-void node_dht_sampling_handler(void *dht) {
+/* True if the cached reading is younger than nodes.dht.cache.max_age */
+bool node_dht_sample_is_fresh() {
+    if (s_node_dht_sample.time <= 0) {
+        return false;
+    }
+    double age = mgos_uptime() - s_node_dht_sample.time;
+    return age * 1000 <= mgos_sys_config_get_nodes_dht_cache_max_age();
+}
+
+static int node_dht_sample_age() {
+    if (s_node_dht_sample.time <= 0) {
+        return -1;
+    }
+    return (int) ((mgos_uptime() - s_node_dht_sample.time) * 1000);
+}
+
+static bool node_dht_read(struct mgos_dht *dht) {
     float t = mgos_dht_get_temp(dht);
     float h = mgos_dht_get_humidity(dht);
     if (isnan(h) || isnan(t)) {
-        LOG(LL_INFO, ("Failed to read data from sensor\n"));
+        s_node_dht_sample.errors++;
+        s_node_dht_sample.total_errors++;
+        return false;
+    }
+    s_node_dht_sample.temp = t;
+    s_node_dht_sample.humd = h;
+    s_node_dht_sample.time = mgos_uptime();
+    s_node_dht_sample.errors = 0;
+    return true;
+}
+
+void node_dht_sampling_handler(void *dht) {
+    if (!node_dht_read(dht)) {
+        NVK_LOG1(NVK_LOG_DHT, LL_WARN, NVK_LOG_MSG_DHT_READ_ERROR, s_node_dht_sample.errors);
+        // The last reading stays in the snapshot but stops counting once stale
+        nvk_live_set(NVK_LIVE_DHT_VALID, node_dht_sample_is_fresh());
         return;
     }
+    float t = s_node_dht_sample.temp;
+    float h = s_node_dht_sample.humd;
 
     int temp_min = mgos_sys_config_get_nodes_dht_props_temp_range_min();
     int temp_max = mgos_sys_config_get_nodes_dht_props_temp_range_max();
     int humd_min = mgos_sys_config_get_nodes_dht_props_humd_range_min();
     int humd_max = mgos_sys_config_get_nodes_dht_props_humd_range_max();
 
-    struct node_range_values temp_values = { .current = t, .min = temp_min, .max = temp_max };
-    if (t < temp_min || t > temp_max) {
-        enum node_out_range_event_type ev;
-        if (t < temp_min) {
-            ev = BELOW_OF_RANGE;
-        } else {
-            ev = ABOVE_OF_RANGE;
-        }
-        s_node_temp_out_range_handler(ev, &temp_values, "Temperature");
-    } else {
-        s_node_temp_on_range_handler(&temp_values, "Temperature");
-    }
-
-    struct node_range_values humd_values = { .current = h, .min = humd_min, .max = humd_max };
-    if(h < humd_min || h > humd_max) {
-        enum node_out_range_event_type ev;
-        if ( h < humd_min) {
-            ev = BELOW_OF_RANGE;
-        } else {
-            ev = ABOVE_OF_RANGE;
-        }
-        s_node_humd_out_range_handler(ev, &humd_values, "Humidity");
-    } else {
-        s_node_humd_on_range_handler(&humd_values, "Humidity");
-    }
+    node_range_threshold_update(&s_node_temp_range, (int) t, temp_min, temp_max);
+    node_range_threshold_update(&s_node_humd_range, (int) h, humd_min, humd_max);
     
-    LOG(LL_INFO, ("Temperature: %d*C \tHumidity: %d%%", (int)t, (int)h));
+    nvk_live_set(NVK_LIVE_TEMP, (int) t);
+    nvk_live_set(NVK_LIVE_HUMD, (int) h);
+    nvk_live_set(NVK_LIVE_DHT_VALID, 1);
+    NVK_LOG2(NVK_LOG_DHT, LL_DEBUG, NVK_LOG_MSG_DHT_SAMPLE, (int)t, (int)h);
     
     (void) dht;
 }
 
 void node_dht_tele_handler(void *dht) {
-    float t = mgos_dht_get_temp(dht);
-    float h = mgos_dht_get_humidity(dht);
-    if (isnan(h) || isnan(t)) {
-        LOG(LL_INFO, ("Failed to read data from sensor\n"));
+    if (!node_dht_sample_is_fresh()) {
+        LOG(LL_INFO, ("No recent data from sensor"));
         return;
     }
+    float t = s_node_dht_sample.temp;
+    float h = s_node_dht_sample.humd;
 
     const char *topic = mgos_sys_config_get_nodes_dht_tele_topic();
     mgos_mqtt_pubf(topic, 1, false, DHT_TELE_JSON_FMT, (int)t, (int)h, mgos_uptime());
-
+    (void) dht;
 }
 
 void node_dht_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args,
                            const char *src, void *dht) {
-  float t = mgos_dht_get_temp(dht);
-  float h = mgos_dht_get_humidity(dht);
-  if(isnan(h) || isnan(t)) {
-    mg_rpc_send_errorf(ri, -1, "{error: \"Failed to read data from sensor\"}");
+  if(!node_dht_sample_is_fresh()) {
+    mg_rpc_send_errorf(ri, -1, "{error: \"Failed to read data from sensor\", errors: %d}", s_node_dht_sample.errors);
   } else {
+    float t = s_node_dht_sample.temp;
+    float h = s_node_dht_sample.humd;
     LOG(LL_INFO, ("Temperature: %d*C \tHumidity: %d%%", (int)t, (int)h));
     const char *topic = mgos_sys_config_get_nodes_dht_tele_topic();
     mgos_mqtt_pubf(topic, 1, false, DHT_TELE_JSON_FMT, (int)t, (int)h, mgos_uptime());
-    mg_rpc_send_responsef(ri, DHT_TELE_JSON_FMT, (int)t, (int)h, mgos_uptime());
+    mg_rpc_send_responsef(ri, DHT_RPC_STAT_JSON_FMT, (int)t, (int)h, mgos_uptime(),
+                          node_dht_sample_age(), s_node_dht_sample.total_errors);
   }
   (void) args;
   (void) src;
+  (void) dht;
 }
 
+/* Cached temperature, NAN when older than nodes.dht.cache.max_age */
 float node_dht_get_temperature() {
-    return mgos_dht_get_temp(s_node_dht);
+    return node_dht_sample_is_fresh() ? s_node_dht_sample.temp : NAN;
 }
 
+/* Cached humidity, NAN when older than nodes.dht.cache.max_age */
 float node_dht_get_humidity() {
-    return mgos_dht_get_humidity(s_node_dht);
+    return node_dht_sample_is_fresh() ? s_node_dht_sample.humd : NAN;
 }
 
 bool node_dht_init() {
@@ -155,9 +185,15 @@ bool node_dht_init() {
         int sampling_interval = mgos_sys_config_get_nodes_dht_sampling_interval();
         int tele_interval = mgos_sys_config_get_nodes_dht_tele_interval();
 
+        int dwell = mgos_sys_config_get_nodes_dht_range_dwell();
+        int interval = mgos_sys_config_get_nodes_dht_range_interval();
+        node_range_threshold_init(&s_node_temp_range, mgos_sys_config_get_nodes_dht_props_temp_range_hysteresis(), dwell, interval, "Temperature");
+        node_range_threshold_init(&s_node_humd_range, mgos_sys_config_get_nodes_dht_props_humd_range_hysteresis(), dwell, interval, "Humidity");
+
         s_node_dht = mgos_dht_create(pin, type);
-        node_dht_samp_int_timer_id = mgos_set_timer(sampling_interval, MGOS_TIMER_REPEAT, node_dht_sampling_handler, s_node_dht);
-        node_dht_tele_int_timer_id = mgos_set_timer(tele_interval, MGOS_TIMER_REPEAT, node_dht_tele_handler, s_node_dht);
+        node_dht_read(s_node_dht);
+        node_dht_samp_int_timer_id = nvk_sched_set(sampling_interval, true, NVK_SCHED_GROUP_NODES, node_dht_sampling_handler, s_node_dht);
+        node_dht_tele_int_timer_id = nvk_sched_set(tele_interval, true, NVK_SCHED_GROUP_NODES, node_dht_tele_handler, s_node_dht);
         mgos_rpc_add_handler(DHT_RPC_STAT_METHOD_NAME, node_dht_rpc_stat_handler, s_node_dht);
 
         node_dht_set_temp_on_range_handler(default_node_dht_on_range_handler);
@@ -16,8 +16,12 @@
  */
 
 #include "mgos.h"
+#include "mgos_bitbang.h"
 #include "mgos_neopixel.h"
+#include "frozen.h"
 #include "nvk_nodes_neopixel.h"
+#include "nvk_trace.h"
+#include "nvk_live.h"
 
 struct mgos_neopixel {
   int pin;
@@ -28,8 +32,100 @@ struct mgos_neopixel {
 
 static struct mgos_neopixel *s_node_neopixel =NULL;
 
-#define NODE_NEOPIXEL_ORDER MGOS_NEOPIXEL_ORDER_GRB
-#define NUM_CHANNELS 3
+/*
+ * Pixel writers generated per channel layout. Each one knows its byte
+ * offsets at compile time and returns the change of the channel sum, so
+ * the per-pixel paths have no order switch. RGBW layouts move the white
+ * shared by the three colours to the W channel. The library is only
+ * given the byte stream (num_pixels * channels rounded up to whole RGB
+ * pixels), the layout is applied here.
+ */
+struct node_neopixel_layout {
+    const char *name;
+    int channels;
+    int (*write)(uint8_t *p, int r, int g, int b);
+    rgb_color (*read)(const uint8_t *p);
+};
+
+#define NODE_NEOPIXEL_LAYOUT_RGB(name, R, G, B) \
+    static int node_neopixel_write_##name(uint8_t *p, int r, int g, int b) { \
+        int old = p[0] + p[1] + p[2]; \
+        p[R] = (uint8_t) r; \
+        p[G] = (uint8_t) g; \
+        p[B] = (uint8_t) b; \
+        return p[0] + p[1] + p[2] - old; \
+    } \
+    static rgb_color node_neopixel_read_##name(const uint8_t *p) { \
+        rgb_color c = { p[R], p[G], p[B] }; \
+        return c; \
+    }
+
+#define NODE_NEOPIXEL_LAYOUT_RGBW(name, R, G, B, W) \
+    static int node_neopixel_write_##name(uint8_t *p, int r, int g, int b) { \
+        int old = p[0] + p[1] + p[2] + p[3]; \
+        uint8_t w = (uint8_t) r < (uint8_t) g ? (uint8_t) r : (uint8_t) g; \
+        w = w < (uint8_t) b ? w : (uint8_t) b; \
+        p[R] = (uint8_t) r - w; \
+        p[G] = (uint8_t) g - w; \
+        p[B] = (uint8_t) b - w; \
+        p[W] = w; \
+        return p[0] + p[1] + p[2] + p[3] - old; \
+    } \
+    static rgb_color node_neopixel_read_##name(const uint8_t *p) { \
+        rgb_color c = { p[R] + p[W], p[G] + p[W], p[B] + p[W] }; \
+        return c; \
+    }
+
+NODE_NEOPIXEL_LAYOUT_RGB(rgb, 0, 1, 2)
+NODE_NEOPIXEL_LAYOUT_RGB(grb, 1, 0, 2)
+NODE_NEOPIXEL_LAYOUT_RGB(bgr, 2, 1, 0)
+NODE_NEOPIXEL_LAYOUT_RGBW(rgbw, 0, 1, 2, 3)
+NODE_NEOPIXEL_LAYOUT_RGBW(grbw, 1, 0, 2, 3)
+
+#define NODE_NEOPIXEL_LAYOUT(name, NAME, channels) \
+    { NAME, channels, node_neopixel_write_##name, node_neopixel_read_##name }
+
+static const struct node_neopixel_layout NODE_NEOPIXEL_LAYOUTS[] = {
+    NODE_NEOPIXEL_LAYOUT(grb, "GRB", 3), // Default, first
+    NODE_NEOPIXEL_LAYOUT(rgb, "RGB", 3),
+    NODE_NEOPIXEL_LAYOUT(bgr, "BGR", 3),
+    NODE_NEOPIXEL_LAYOUT(grbw, "GRBW", 4),
+    NODE_NEOPIXEL_LAYOUT(rgbw, "RGBW", 4)
+};
+
+#define NODE_NEOPIXEL_LAYOUTS_COUNT (int) (sizeof(NODE_NEOPIXEL_LAYOUTS) / sizeof(NODE_NEOPIXEL_LAYOUTS[0]))
+
+static const struct node_neopixel_layout *s_layout = &NODE_NEOPIXEL_LAYOUTS[0];
+static int s_num_pixels = 0;
+static int s_data_len = 0; // Bytes of the buffer actually sent
+
+#define POWER_SCALE_FULL 256
+#define POWER_RELEASE_SHIFT 3 // The limit is lifted by 1/8 of the gap per frame
+
+static uint32_t s_channel_sum = 0; // Sum of every channel byte in the buffer
+static int s_power_scale = POWER_SCALE_FULL;
+static uint8_t *s_power_data = NULL; // Scaled copy sent while limiting, made on first use
+static bool s_power_logged = false;
+
+/*
+ * Streaming keeps no frame buffer. Tile renderers fill s_tile, which is
+ * encoded into s_tile_data and sent before the next chunk is rendered,
+ * so the peak is one chunk whatever the strip length. The strip latches
+ * when the line stays low for its reset time (50 us on WS2812, 280 us on
+ * WS2812B), rendering a chunk has to stay below it. Effects without a
+ * tile renderer still work, the full buffer is created on first use.
+ * Only rainbow, rainbow cycle and the whole strip effects (strobe, fade,
+ * flash, RGB loop, audio beat, on/off) stay without a buffer. Anything
+ * that writes or reads single pixels (cylon, twinkle, meteor, snow, fire,
+ * audio VU and spectrum, program, animation, matrix) creates it.
+ */
+static int s_pin = -1;
+static bool s_streaming = false;
+static int s_chunk = 0;
+static rgb_color *s_tile = NULL; // Pixels of the chunk being rendered
+static uint8_t *s_tile_data = NULL; // The same chunk encoded for the strip
+static uint32_t s_stream_sum = 0; // Channel sum of the last streamed frame
+static bool s_buffer_logged = false; // The fallback to a full buffer is logged once
 
 rgb_color get_rgb_color(int color) {
     int r = (color >> 16) & 0xFF;
@@ -47,19 +143,129 @@ int get_hex_color(int r, int g, int b) {
     return h;
 }
 
+/* Creates the full buffer, only deferred when streaming */
+static bool node_neopixel_buffer() {
+    if (s_node_neopixel != NULL) {
+        return true;
+    }
+    // The library is given whole RGB pixels, the layout is written here
+    int stream_pixels = (s_num_pixels * s_layout->channels + 2) / 3;
+    s_node_neopixel = mgos_neopixel_create(s_pin, stream_pixels, MGOS_NEOPIXEL_ORDER_RGB);
+    if (s_node_neopixel == NULL) {
+        return false;
+    }
+    if (s_streaming && !s_buffer_logged) {
+        s_buffer_logged = true;
+        LOG(LL_WARN, ("Streaming strip falls back to a %d byte frame buffer", stream_pixels * 3));
+    }
+    s_data_len = stream_pixels * 3;
+    s_channel_sum = 0;
+    return true;
+}
+
+/* Keeps s_channel_sum current, the buffer is never rescanned */
+static void node_neopixel_write(int pixel, int r, int g, int b) {
+    if (pixel < 0 || pixel >= s_num_pixels || !node_neopixel_buffer()) {
+        return;
+    }
+    s_channel_sum += s_layout->write(s_node_neopixel->data + pixel * s_layout->channels, r, g, b);
+}
+
+/* Encodes the colour once and copies it over the whole buffer */
+static void node_neopixel_fill(int r, int g, int b) {
+    if (s_num_pixels == 0 || !node_neopixel_buffer()) {
+        return;
+    }
+    int channels = s_layout->channels;
+    uint8_t *data = s_node_neopixel->data;
+    memset(data, 0, channels);
+    int sum = s_layout->write(data, r, g, b);
+    for (int p = 1; p < s_num_pixels; p++) {
+        memcpy(data + p * channels, data, channels);
+    }
+    s_channel_sum = (uint32_t) sum * s_num_pixels;
+}
+
+/* Estimated current (mA) of a frame of channel sum shown at scale / POWER_SCALE_FULL */
+static int node_neopixel_power(uint32_t sum, int scale) {
+    int idle = mgos_sys_config_get_nodes_neopixel_power_idle_ma() * s_num_pixels;
+    uint32_t full = sum * mgos_sys_config_get_nodes_neopixel_power_channel_ma() / 255;
+    return idle + (int) (full * scale / POWER_SCALE_FULL);
+}
+
+/* Drops the brightness at once when over budget and lifts it slowly */
+static void node_neopixel_govern(uint32_t sum) {
+    int budget = mgos_sys_config_get_nodes_neopixel_power_budget();
+    int target = POWER_SCALE_FULL;
+    if (budget > 0) {
+        int idle = node_neopixel_power(sum, 0);
+        int full = node_neopixel_power(sum, POWER_SCALE_FULL) - idle;
+        if (full > 0 && idle + full > budget) {
+            target = budget > idle ? (budget - idle) * POWER_SCALE_FULL / full : 0;
+        }
+    }
+    if (target < s_power_scale) {
+        s_power_scale = target;
+    } else if (target > s_power_scale) {
+        s_power_scale += (target - s_power_scale + (1 << POWER_RELEASE_SHIFT) - 1) >> POWER_RELEASE_SHIFT;
+    }
+    nvk_live_set(NVK_LIVE_POWER, node_neopixel_power(sum, s_power_scale));
+    nvk_live_set(NVK_LIVE_POWER_LIMIT, s_power_scale * 100 / POWER_SCALE_FULL);
+}
+
+static void node_neopixel_commit() {
+    if (!node_neopixel_buffer()) {
+        return;
+    }
+    node_neopixel_govern(s_channel_sum);
+    if (s_power_scale < POWER_SCALE_FULL) {
+        if (s_power_data == NULL) {
+            s_power_data = (uint8_t *) calloc(s_data_len, 1);
+        }
+        if (s_power_data == NULL) {
+            // Showing the frame unscaled would draw more than the budget
+            if (!s_power_logged) {
+                s_power_logged = true;
+                LOG(LL_ERROR, ("No memory for the power limited frame, frames over budget are dropped"));
+            }
+            return;
+        }
+        uint8_t *data = s_node_neopixel->data;
+        for (int i = 0; i < s_data_len; i++) {
+            s_power_data[i] = (data[i] * s_power_scale) >> 8;
+        }
+        s_node_neopixel->data = s_power_data;
+        mgos_neopixel_show(s_node_neopixel);
+        s_node_neopixel->data = data;
+    } else {
+        mgos_neopixel_show(s_node_neopixel);
+    }
+    nvk_trace_stamp(NVK_TRACE_SHOW);
+}
+
+static int node_neopixel_tiles_to_strip(node_neopixel_tile_render render, void *arg);
+
+static void node_neopixel_solid_tile(int first, int count, rgb_color *out, void *arg) {
+    for (int i = 0; i < count; i++) {
+        out[i] = *(const rgb_color *) arg;
+    }
+    (void) first;
+}
+
 void node_neopixel_set_all_pixels(rgb_color rgb) {
-    mgos_neopixel_clear(s_node_neopixel);
-    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
-    for(int p = 0; p < num_pixels; p++) {
-        mgos_neopixel_set(s_node_neopixel, p, rgb.red, rgb.green, rgb.blue);
+    if (s_streaming && s_node_neopixel == NULL) {
+        // Turning on, off and ramps need no buffer either
+        node_neopixel_tiles_to_strip(node_neopixel_solid_tile, &rgb);
+        return;
     }
-    mgos_neopixel_show(s_node_neopixel);
+    node_neopixel_fill(rgb.red, rgb.green, rgb.blue);
+    node_neopixel_commit();
 }
 
 void node_neopixel_set_pixel(int pixel, rgb_color rgb) {
-    mgos_neopixel_clear(s_node_neopixel);
-    mgos_neopixel_set(s_node_neopixel, pixel, rgb.red, rgb.green, rgb.blue);
-    mgos_neopixel_show(s_node_neopixel);
+    node_neopixel_clear();
+    node_neopixel_write(pixel, rgb.red, rgb.green, rgb.blue);
+    node_neopixel_commit();
 }
 
 void node_neopixel_turn_off() {
@@ -79,22 +285,206 @@ void node_neopixel_set_brightness(int brightness) {
 }
 
 void node_neopixel_clear() {
+    if (!node_neopixel_buffer()) {
+        return;
+    }
     mgos_neopixel_clear(s_node_neopixel);
+    s_channel_sum = 0;
 }
 
 void node_neopixel_set(int pixel, int r, int g, int b) {
-    mgos_neopixel_set(s_node_neopixel, pixel, r, g, b);
+    node_neopixel_write(pixel, r, g, b);
 }
 
 void node_neopixe_set_all(int r, int g, int b) {
-    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
-    for(int p = 0; p < num_pixels; p++) {
-        mgos_neopixel_set(s_node_neopixel, p, r, g, b);
-    }
+    node_neopixel_fill(r, g, b);
 }
 
 void node_neopixel_show() {
-    mgos_neopixel_show(s_node_neopixel);
+    node_neopixel_commit();
+}
+
+bool node_neopixel_streaming() {
+    return s_streaming;
+}
+
+static int node_neopixel_tile_count(int first) {
+    return s_num_pixels - first < s_chunk ? s_num_pixels - first : s_chunk;
+}
+
+static void node_neopixel_tiles_render(node_neopixel_tile_render render, void *arg) {
+    for (int first = 0; first < s_num_pixels; first += s_chunk) {
+        int count = node_neopixel_tile_count(first);
+        render(first, count, s_tile, arg);
+        for (int i = 0; i < count; i++) {
+            node_neopixel_write(first + i, s_tile[i].red, s_tile[i].green, s_tile[i].blue);
+        }
+    }
+}
+
+/* Renders into the full buffer, then shows it as any other frame */
+static void node_neopixel_tiles_to_buffer(node_neopixel_tile_render render, void *arg) {
+    node_neopixel_tiles_render(render, arg);
+    node_neopixel_commit();
+}
+
+/* Sends each chunk as soon as it is rendered, the widest gap (us) between chunks is
+ * returned. Without send the chunks are only rendered and encoded, for measuring. */
+static int node_neopixel_tiles_encode(node_neopixel_tile_render render, void *arg, bool send) {
+    if (s_tile == NULL || s_tile_data == NULL) {
+        return 0;
+    }
+    int channels = s_layout->channels;
+    uint32_t sum = 0;
+    int gap = 0;
+    if (send) {
+        // The last frame's sum sets the limit, this one is only known once sent
+        node_neopixel_govern(s_stream_sum);
+        mgos_gpio_write(s_pin, 0);
+        mgos_usleep(60);
+    }
+    for (int first = 0; first < s_num_pixels; first += s_chunk) {
+        int count = node_neopixel_tile_count(first);
+        int64_t rendering = mgos_uptime_micros();
+        render(first, count, s_tile, arg);
+        memset(s_tile_data, 0, count * channels);
+        for (int i = 0; i < count; i++) {
+            sum += s_layout->write(s_tile_data + i * channels, s_tile[i].red, s_tile[i].green, s_tile[i].blue);
+        }
+        if (s_power_scale < POWER_SCALE_FULL) {
+            for (int i = 0; i < count * channels; i++) {
+                s_tile_data[i] = (s_tile_data[i] * s_power_scale) >> 8;
+            }
+        }
+        int64_t now = mgos_uptime_micros();
+        if (first > 0 && now - rendering > gap) {
+            gap = (int) (now - rendering);
+        }
+        if (send) {
+            mgos_bitbang_write_bits(s_pin, MGOS_DELAY_100NSEC, 3, 8, 8, 6, s_tile_data, count * channels);
+        }
+    }
+    if (send) {
+        mgos_gpio_write(s_pin, 0);
+        mgos_usleep(60);
+        s_stream_sum = sum;
+        nvk_trace_stamp(NVK_TRACE_SHOW);
+    }
+    return gap;
+}
+
+static int node_neopixel_tiles_to_strip(node_neopixel_tile_render render, void *arg) {
+    return node_neopixel_tiles_encode(render, arg, true);
+}
+
+uint8_t *node_neopixel_frame_save() {
+    if (s_node_neopixel == NULL) {
+        return NULL;
+    }
+    uint8_t *frame = (uint8_t *) malloc(s_data_len);
+    if (frame != NULL) {
+        memcpy(frame, s_node_neopixel->data, s_data_len);
+    }
+    return frame;
+}
+
+void node_neopixel_frame_restore(uint8_t *frame) {
+    if (frame == NULL || s_node_neopixel == NULL) {
+        free(frame);
+        return;
+    }
+    memcpy(s_node_neopixel->data, frame, s_data_len);
+    s_channel_sum = 0;
+    for (int i = 0; i < s_data_len; i++) {
+        s_channel_sum += frame[i];
+    }
+    free(frame);
+}
+
+void node_neopixel_stream(node_neopixel_tile_render render, void *arg) {
+    if (s_tile == NULL || s_tile_data == NULL) {
+        return;
+    }
+    if (s_streaming) {
+        node_neopixel_tiles_to_strip(render, arg);
+    } else {
+        node_neopixel_tiles_to_buffer(render, arg);
+    }
+}
+
+#define NODE_NEOPIXEL_BENCH_MAX_PIXEL_FRAMES 20000
+
+static void node_neopixel_bench_tile(int first, int count, rgb_color *out, void *arg) {
+    int t = *(int *) arg;
+    for (int i = 0; i < count; i++) {
+        int h = (first + i + t) & 0xFF;
+        rgb_color c = { h, 255 - h, (h * 2) & 0xFF };
+        out[i] = c;
+    }
+}
+
+/*
+ * Driver.StreamBench {frames: 20}: the same frames rendered into the full
+ * buffer and chunk by chunk. Nothing is sent to the strip and the running
+ * effect's frame is put back. The run is capped to
+ * NODE_NEOPIXEL_BENCH_MAX_PIXEL_FRAMES so it stays short of the watchdog.
+ */
+void node_neopixel_rpc_stream_bench_handler(struct mg_rpc_request_info *ri, const char *args,
+                                            const char *src, void *user_data) {
+    int frames = 20;
+    json_scanf(args, strlen(args), "{frames: %d}", &frames);
+    int max_frames = NODE_NEOPIXEL_BENCH_MAX_PIXEL_FRAMES / (s_num_pixels > 0 ? s_num_pixels : 1);
+    if (frames <= 0) {
+        frames = 20;
+    }
+    if (frames > max_frames) {
+        frames = max_frames > 0 ? max_frames : 1;
+    }
+    if (s_tile == NULL || s_tile_data == NULL) {
+        mg_rpc_send_errorf(ri, -1, "{error: \"Strip disabled\"}");
+        return;
+    }
+    size_t heap = mgos_get_free_heap_size();
+    bool created = s_node_neopixel == NULL;
+    if (!node_neopixel_buffer()) {
+        mg_rpc_send_errorf(ri, -1, "{error: \"Out of memory\", pixels: %d}", s_num_pixels);
+        return;
+    }
+    int buffer_bytes = created ? (int) (heap - mgos_get_free_heap_size()) : s_data_len;
+    uint8_t *frame = created ? NULL : node_neopixel_frame_save();
+    if (!created && frame == NULL) {
+        mg_rpc_send_errorf(ri, -1, "{error: \"Out of memory to keep the frame\"}");
+        return;
+    }
+
+    int64_t start = mgos_uptime_micros();
+    for (int t = 0; t < frames; t++) {
+        node_neopixel_tiles_render(node_neopixel_bench_tile, &t);
+    }
+    int64_t buffered = mgos_uptime_micros() - start;
+    int gap = 0;
+    start = mgos_uptime_micros();
+    for (int t = 0; t < frames; t++) {
+        int g = node_neopixel_tiles_encode(node_neopixel_bench_tile, &t, false);
+        gap = g > gap ? g : gap;
+    }
+    int64_t streamed = mgos_uptime_micros() - start;
+
+    node_neopixel_frame_restore(frame);
+    if (created) {
+        // Streaming strips give the buffer back, it was only made for the comparison
+        mgos_neopixel_free(s_node_neopixel);
+        s_node_neopixel = NULL;
+        free(s_power_data);
+        s_power_data = NULL;
+    }
+    mg_rpc_send_responsef(ri, "{pixels:%d,chunk:%d,frames:%d,buffer_us:%d,buffer_bytes:%d,"
+                          "stream_us:%d,stream_bytes:%d,stream_gap_us:%d}",
+                          s_num_pixels, s_chunk, frames, (int) (buffered / frames), buffer_bytes,
+                          (int) (streamed / frames),
+                          (int) (s_chunk * (sizeof(rgb_color) + s_layout->channels)), gap);
+    (void) src;
+    (void) user_data;
 }
 
 bool node_neopixel_init() {
@@ -102,27 +492,38 @@ bool node_neopixel_init() {
     if (enabled) {
         int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
         int pin = mgos_sys_config_get_nodes_neopixel_pin();
-        s_node_neopixel = mgos_neopixel_create(pin, num_pixels, NODE_NEOPIXEL_ORDER);
+        const char *order = mgos_sys_config_get_nodes_neopixel_order();
+        for (int l = 0; l < NODE_NEOPIXEL_LAYOUTS_COUNT; l++) {
+            if (order != NULL && strcmp(order, NODE_NEOPIXEL_LAYOUTS[l].name) == 0) {
+                s_layout = &NODE_NEOPIXEL_LAYOUTS[l];
+                break;
+            }
+        }
+        if (order == NULL || strcmp(order, s_layout->name) != 0) {
+            LOG(LL_ERROR, ("Wrong order: %s, using %s", order ? order : "", s_layout->name));
+        }
+        s_pin = pin;
+        s_num_pixels = num_pixels;
+        s_streaming = mgos_sys_config_get_nodes_neopixel_stream_enable();
+        s_chunk = mgos_sys_config_get_nodes_neopixel_stream_chunk();
+        if (s_chunk <= 0 || s_chunk > num_pixels) {
+            s_chunk = num_pixels > 0 ? num_pixels : 1;
+        }
+        s_tile = (rgb_color *) calloc(s_chunk, sizeof(rgb_color));
+        s_tile_data = (uint8_t *) calloc(s_chunk, s_layout->channels);
+        if (s_streaming) {
+            mgos_gpio_set_mode(pin, MGOS_GPIO_MODE_OUTPUT);
+            mgos_gpio_write(pin, 0);
+        } else {
+            node_neopixel_buffer();
+        }
     }
     return enabled;
 }
 
 rgb_color node_neopixel_get_pixel_color(int pixel) {
-    uint8_t *p = s_node_neopixel->data + pixel * NUM_CHANNELS;
-    int hex_color = 0;
-    switch (s_node_neopixel->order) {
-        case MGOS_NEOPIXEL_ORDER_RGB:
-            hex_color = get_hex_color(p[0], p[1], p[2]);
-            break;
-        case MGOS_NEOPIXEL_ORDER_GRB:
-            hex_color = get_hex_color(p[1], p[0], p[2]);
-            break;
-        case MGOS_NEOPIXEL_ORDER_BGR:
-            hex_color = get_hex_color(p[2], p[1], p[0]);
-            break;
-        default:
-            LOG(LL_ERROR, ("Wrong order: %d", s_node_neopixel->order));
-            break;
-    }
-    return get_rgb_color(hex_color);
+    if (pixel < 0 || pixel >= s_num_pixels || !node_neopixel_buffer()) {
+        return get_rgb_color(0);
+    }
+    return s_layout->read(s_node_neopixel->data + pixel * s_layout->channels);
 }
\ No newline at end of file
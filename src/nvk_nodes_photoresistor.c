@@ -18,26 +18,38 @@
 #include "mgos.h"
 #include "mgos_adc.h"
 #include "nvk_nodes.h"
+#include "nvk_sched.h"
 #include "nvk_nodes_photoresistor.h"
 #include "mgos_time.h"
 #include "mgos_mqtt.h"
 #include "mgos_rpc.h"
+#include "nvk_log.h"
+#include "nvk_live.h"
 
-static node_on_range_handler_t s_node_photoresistor_lum_on_range_handler = NULL;
-static node_out_range_handler_t s_node_photoresistor_lum_out_range_handler = NULL;
+#define PHOTORESISTOR_MEDIAN_SIZE 5
+#define PHOTORESISTOR_ALPHA_MAX 256
+
+static struct node_range_threshold s_node_photoresistor_lum_range = { .state = NODE_RANGE_UNKNOWN };
 
 const char PHOTORESISTOR_TELE_JSON_FMT[] = "{photoresistor:{luminosity:%d,uptime:%f}}";
 const char PHOTORESISTOR_RPC_STAT_METHOD_NAME[] = "Nodes.Photoresistor.Stat";
 
-static mgos_timer_id node_photoresistor_samp_int_timer_id = MGOS_INVALID_TIMER_ID;
-static mgos_timer_id node_photoresistor_tele_int_timer_id = MGOS_INVALID_TIMER_ID;
+static nvk_sched_id node_photoresistor_samp_int_timer_id = NVK_SCHED_INVALID_ID;
+static nvk_sched_id node_photoresistor_tele_int_timer_id = NVK_SCHED_INVALID_ID;
+
+static int s_node_photoresistor_pin = 0;
+static int s_node_photoresistor_window[PHOTORESISTOR_MEDIAN_SIZE];
+static int s_node_photoresistor_window_len = 0;
+static int s_node_photoresistor_window_pos = 0;
+static int s_node_photoresistor_filtered = -1; // Smoothed value x256, -1 until first sample
+static bool s_node_photoresistor_dark = true; // Without sensor night light always applies
 
 void node_photoresistor_set_lum_on_range_handler(node_on_range_handler_t func) {
-    s_node_photoresistor_lum_on_range_handler = func;
+    s_node_photoresistor_lum_range.on_range = func;
 }
 
 void node_photoresistor_set_lum_out_range_handler(node_out_range_handler_t func) {
-    s_node_photoresistor_lum_out_range_handler = func;
+    s_node_photoresistor_lum_range.out_range = func;
 }
 
 void default_node_photoresistor_on_range_handler(struct node_range_values *values, void *user_data) {
@@ -55,34 +67,84 @@ void default_node_photoresistor_out_range_handler(enum node_out_range_event_type
     }
 }
 
+/* Raw ADC read, only the sampling timer should need it */
+int node_photoresistor_read_raw() {
+    return mgos_adc_read(s_node_photoresistor_pin);
+}
+
+static int node_photoresistor_median() {
+    int sorted[PHOTORESISTOR_MEDIAN_SIZE];
+    int n = s_node_photoresistor_window_len;
+    for (int i = 0; i < n; i++) {
+        int j = i;
+        for (; j > 0 && sorted[j - 1] > s_node_photoresistor_window[i]; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = s_node_photoresistor_window[i];
+    }
+    return sorted[n / 2];
+}
+
+static int node_photoresistor_alpha() {
+    int alpha = mgos_sys_config_get_nodes_photoresistor_filter_alpha();
+    return alpha < 1 ? 1 : alpha > PHOTORESISTOR_ALPHA_MAX ? PHOTORESISTOR_ALPHA_MAX : alpha;
+}
+
+/* Median of the last samples rejects spikes, the EMA smooths what is left.
+ * Steps are rounded and at least one unit, so the filter reaches the median
+ * from either side instead of stalling a fraction below it. */
+static void node_photoresistor_update(int raw) {
+    s_node_photoresistor_window[s_node_photoresistor_window_pos] = raw;
+    s_node_photoresistor_window_pos = (s_node_photoresistor_window_pos + 1) % PHOTORESISTOR_MEDIAN_SIZE;
+    if (s_node_photoresistor_window_len < PHOTORESISTOR_MEDIAN_SIZE) {
+        s_node_photoresistor_window_len++;
+    }
+    int median = node_photoresistor_median() << 8;
+    if (s_node_photoresistor_filtered < 0) {
+        s_node_photoresistor_filtered = median;
+    } else {
+        int gap = median - s_node_photoresistor_filtered;
+        int step = (gap * node_photoresistor_alpha() + 128) >> 8;
+        if (step == 0 && gap != 0) {
+            step = gap > 0 ? 1 : -1;
+        }
+        s_node_photoresistor_filtered += step;
+    }
+
+    int l = node_photoresistor_get_luminosity();
+    int threshold = mgos_sys_config_get_pir_threshold();
+    int hysteresis = mgos_sys_config_get_nodes_photoresistor_filter_hysteresis();
+    if (s_node_photoresistor_dark && l > threshold + hysteresis) {
+        s_node_photoresistor_dark = false;
+    } else if (!s_node_photoresistor_dark && l <= threshold - hysteresis) {
+        s_node_photoresistor_dark = true;
+    }
+}
+
+/* Filtered luminosity, no ADC access */
 int node_photoresistor_get_luminosity() {
-    if(mgos_adc_enable(0)) {
-        return mgos_adc_read(0);
+    if (s_node_photoresistor_filtered < 0) {
+        return 0;
     }
-    LOG(LL_INFO, ("ADC not available"));
-    return 0;
+    return (s_node_photoresistor_filtered + 128) >> 8;
+}
+
+/* Dark/light decision with hysteresis around pir.threshold */
+bool node_photoresistor_is_dark() {
+    return s_node_photoresistor_dark;
 }
 
 void node_photoresistor_sampling_handler(void *user_data) {
+    node_photoresistor_update(node_photoresistor_read_raw());
     int l = node_photoresistor_get_luminosity();
     
     int lumi_min = mgos_sys_config_get_nodes_photoresistor_props_lumi_range_min();
     int lumi_max = mgos_sys_config_get_nodes_photoresistor_props_lumi_range_max();
 
-    struct node_range_values lumi_values = { .current = l, .min = lumi_min, .max = lumi_max };
-    if (l < lumi_min || l > lumi_max) {
-        enum node_out_range_event_type ev;
-        if (l < lumi_min) {
-            ev = BELOW_OF_RANGE;
-        } else {
-            ev = ABOVE_OF_RANGE;
-        }
-        s_node_photoresistor_lum_out_range_handler(ev, &lumi_values, "Luminosity");
-    } else {
-        s_node_photoresistor_lum_on_range_handler(&lumi_values, "Luminosity");
-    }
+    node_range_threshold_update(&s_node_photoresistor_lum_range, l, lumi_min, lumi_max);
+    nvk_live_set(NVK_LIVE_LUM, l);
 
-    LOG(LL_INFO, ("Luminosity: %d lux", l));
+    NVK_LOG1(NVK_LOG_PHOTORESISTOR, LL_DEBUG, NVK_LOG_MSG_LUMINOSITY, l);
     
     (void) user_data;
 }
@@ -107,15 +169,32 @@ void node_photoresistor_rpc_stat_handler(struct mg_rpc_request_info *ri, const c
 
 bool node_photoresistor_init() {
     int pin = mgos_sys_config_get_nodes_photoresistor_pin();
-    bool enabled = mgos_sys_config_get_nodes_photoresistor_enable() && mgos_adc_enable(pin);
+    bool enabled = mgos_sys_config_get_nodes_photoresistor_enable();
+    if (enabled && !mgos_adc_enable(pin)) {
+        LOG(LL_ERROR, ("Photoresistor ADC pin %d not available", pin));
+        enabled = false;
+    }
     if(enabled) {
+        int alpha = mgos_sys_config_get_nodes_photoresistor_filter_alpha();
+        if (alpha != node_photoresistor_alpha()) {
+            LOG(LL_WARN, ("Photoresistor filter alpha %d out of 1 - %d, using %d", alpha,
+                          PHOTORESISTOR_ALPHA_MAX, node_photoresistor_alpha()));
+        }
+        s_node_photoresistor_pin = pin;
+        node_range_threshold_init(&s_node_photoresistor_lum_range,
+                                  mgos_sys_config_get_nodes_photoresistor_props_lumi_range_hysteresis(),
+                                  mgos_sys_config_get_nodes_photoresistor_range_dwell(),
+                                  mgos_sys_config_get_nodes_photoresistor_range_interval(), "Luminosity");
         int sampling_interval = mgos_sys_config_get_nodes_photoresistor_sampling_interval();
         int tele_interval = mgos_sys_config_get_nodes_photoresistor_tele_interval();
-        node_photoresistor_samp_int_timer_id = mgos_set_timer(sampling_interval, MGOS_TIMER_REPEAT, node_photoresistor_sampling_handler, NULL);
-        node_photoresistor_tele_int_timer_id = mgos_set_timer(tele_interval, MGOS_TIMER_REPEAT, node_photoresistor_tele_handler, NULL);
+        // Seed the filter so is_dark() has a value before the first timer tick
+        node_photoresistor_update(node_photoresistor_read_raw());
+        s_node_photoresistor_dark = node_photoresistor_get_luminosity() <= mgos_sys_config_get_pir_threshold();
+        node_photoresistor_samp_int_timer_id = nvk_sched_set(sampling_interval, true, NVK_SCHED_GROUP_NODES, node_photoresistor_sampling_handler, NULL);
+        node_photoresistor_tele_int_timer_id = nvk_sched_set(tele_interval, true, NVK_SCHED_GROUP_NODES, node_photoresistor_tele_handler, NULL);
         mgos_rpc_add_handler(PHOTORESISTOR_RPC_STAT_METHOD_NAME, node_photoresistor_rpc_stat_handler, NULL);
         node_photoresistor_set_lum_on_range_handler(default_node_photoresistor_on_range_handler);
         node_photoresistor_set_lum_out_range_handler(default_node_photoresistor_out_range_handler);
     }
     return enabled;
-}
\ No newline at end of file
+}
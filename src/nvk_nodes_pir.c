@@ -17,19 +17,62 @@
 
 #include "mgos.h"
 #include "nvk_nodes.h"
+#include "nvk_sched.h"
 #include "nvk_nodes_pir.h"
 #include "mgos_time.h"
 #include "mgos_mqtt.h"
+#include "mgos_rpc.h"
+#include "frozen.h"
+#include "nvk_log.h"
 
-static mgos_timer_id node_pir_samp_int_timer_id = MGOS_INVALID_TIMER_ID;
+#define NODE_PIR_EDGE_QUEUE_SIZE 16
+#define NODE_PIR_INJECT_MAX_EDGES 32
+
+struct node_pir_edge {
+    int value;
+    int64_t time; // Edge uptime (us)
+};
+
+static nvk_sched_id node_pir_samp_int_timer_id = NVK_SCHED_INVALID_ID;
+static nvk_sched_id node_pir_settle_timer_id = NVK_SCHED_INVALID_ID;
 static node_switch_handler_t s_node_pir_toggle_handler = NULL;
 
 static int s_node_pir_state = 0;
+static bool s_node_pir_irq = false; // The ISR is installed and may push edges
+static int64_t s_node_pir_last_edge_time = 0;
+
+/* Edges are produced by the GPIO ISR and consumed by the main loop. Main loop
+ * producers go through node_pir_queue_edge, which masks the ISR, so the ring
+ * only ever has one producer running at a time. */
+static struct node_pir_edge s_node_pir_edges[NODE_PIR_EDGE_QUEUE_SIZE];
+static volatile int s_node_pir_edges_head = 0;
+static volatile int s_node_pir_edges_tail = 0;
+static volatile bool s_node_pir_drain_pending = false;
+static volatile int s_node_pir_dropped_edges = 0;
+
+static int s_node_pir_accepted_edges = 0;
+static int s_node_pir_rejected_edges = 0;
+
+/* Nodes.PIR.Inject in progress, one edge per gap replayed at its own time */
+struct node_pir_inject {
+    struct mg_rpc_request_info *ri;
+    char *edges;
+    int next;
+    int gap;
+    int accepted;
+    int rejected;
+    int dropped;
+    int64_t latency; // Worst queue to processed time of an edge (us)
+};
+
+static struct node_pir_inject s_node_pir_inject = { 0 };
 
 const char PIR_STAT_JSON_FMT[] = "{pir:{state:%d,uptime:%f}}";
+const char PIR_INJECT_JSON_FMT[] = "{accepted:%d,rejected:%d,dropped:%d,state:%d,latency_us:%lld}";
+const char PIR_RPC_INJECT_METHOD_NAME[] = "Nodes.PIR.Inject";
 
 void default_node_pir_toggle_handler(int value, void *user_data) {
-    LOG(LL_INFO, ("PIR: %d", value));
+    NVK_LOG1(NVK_LOG_PIR, LL_INFO, NVK_LOG_MSG_PIR_TOGGLE, value);
     (void) user_data;
 }
 
@@ -37,26 +80,178 @@ void node_pir_set_pir_toggle_handler(node_switch_handler_t func) {
     s_node_pir_toggle_handler = func;
 }
 
+int node_pir_get_state() {
+    return s_node_pir_state;
+}
+
+int64_t node_pir_get_last_edge_time() {
+    return s_node_pir_last_edge_time;
+}
+
+static IRAM bool node_pir_push_edge(int value, int64_t time) {
+    int next = (s_node_pir_edges_head + 1) % NODE_PIR_EDGE_QUEUE_SIZE;
+    if (next == s_node_pir_edges_tail) {
+        s_node_pir_dropped_edges++;
+        return false;
+    }
+    s_node_pir_edges[s_node_pir_edges_head].value = value;
+    s_node_pir_edges[s_node_pir_edges_head].time = time;
+    s_node_pir_edges_head = next;
+    return true;
+}
+
+/* Push from the main loop, the PIR interrupt can not interleave on the head */
+static bool node_pir_queue_edge(int value, int64_t time) {
+    int pin = mgos_sys_config_get_nodes_pir_pin();
+    if (s_node_pir_irq) {
+        mgos_gpio_disable_int(pin);
+    }
+    bool queued = node_pir_push_edge(value, time);
+    if (s_node_pir_irq) {
+        mgos_gpio_enable_int(pin);
+    }
+    return queued;
+}
+
+static void node_pir_settle_handler(void *args);
+
+/* Leading edge debounce: the first edge is delivered at once, bounces inside
+ * the window are dropped and the pin level is checked again when it closes. */
+static bool node_pir_process_edge(int value, int64_t time) {
+    if (value == s_node_pir_state) {
+        return false;
+    }
+    int64_t debounce = (int64_t) mgos_sys_config_get_nodes_pir_irq_debounce() * 1000;
+    int64_t elapsed = time - s_node_pir_last_edge_time;
+    if (s_node_pir_last_edge_time > 0 && elapsed < debounce) {
+        s_node_pir_rejected_edges++;
+        if (node_pir_settle_timer_id == NVK_SCHED_INVALID_ID) {
+            int wait = (int) ((debounce - elapsed) / 1000) + 1;
+            node_pir_settle_timer_id = nvk_sched_set(wait, false, NVK_SCHED_GROUP_NODES, node_pir_settle_handler, NULL);
+        }
+        return false;
+    }
+    s_node_pir_state = value;
+    s_node_pir_last_edge_time = time;
+    s_node_pir_accepted_edges++;
+    s_node_pir_toggle_handler(value, NULL);
+    const char *topic = mgos_sys_config_get_nodes_pir_stat_topic();
+    mgos_mqtt_pubf(topic, 1, false, PIR_STAT_JSON_FMT, value, time / 1000000.0);
+    return true;
+}
+
+static void node_pir_drain_edges(void *args) {
+    s_node_pir_drain_pending = false;
+    while (s_node_pir_edges_tail != s_node_pir_edges_head) {
+        struct node_pir_edge edge = s_node_pir_edges[s_node_pir_edges_tail];
+        s_node_pir_edges_tail = (s_node_pir_edges_tail + 1) % NODE_PIR_EDGE_QUEUE_SIZE;
+        node_pir_process_edge(edge.value, edge.time);
+    }
+    (void) args;
+}
+
+static IRAM void node_pir_int_handler(int pin, void *args) {
+    if (node_pir_push_edge(mgos_gpio_read(pin), mgos_uptime_micros()) && !s_node_pir_drain_pending) {
+        s_node_pir_drain_pending = true;
+        mgos_invoke_cb(node_pir_drain_edges, NULL, true);
+    }
+    (void) args;
+}
+
+static void node_pir_settle_handler(void *args) {
+    node_pir_settle_timer_id = NVK_SCHED_INVALID_ID;
+    node_pir_queue_edge(mgos_gpio_read(mgos_sys_config_get_nodes_pir_pin()), mgos_uptime_micros());
+    node_pir_drain_edges(NULL);
+    (void) args;
+}
+
+/* Polling is only a fallback for lost interrupts when the IRQ is enabled */
 void node_pir_sampling_handler(void *args) {
-    bool state = mgos_gpio_read(mgos_sys_config_get_nodes_pir_pin());
+    int state = mgos_gpio_read(mgos_sys_config_get_nodes_pir_pin());
     if (state != s_node_pir_state) {
-        s_node_pir_toggle_handler(state, NULL);
-        const char *topic = mgos_sys_config_get_nodes_pir_stat_topic();
-        mgos_mqtt_pubf(topic, 1, false, PIR_STAT_JSON_FMT, state, mgos_uptime());
+        node_pir_queue_edge(state, mgos_uptime_micros());
+        node_pir_drain_edges(NULL);
+    }
+    (void) args;
+}
+
+/* Feed a synthetic edge through the same queue used by the ISR, stamped now
+ * as the ISR would so the debounce never sees an edge from the future */
+bool node_pir_inject_edge(int value) {
+    int64_t start = mgos_uptime_micros();
+    bool queued = node_pir_queue_edge(value ? 1 : 0, start);
+    node_pir_drain_edges(NULL);
+    int64_t latency = mgos_uptime_micros() - start;
+    if (latency > s_node_pir_inject.latency) {
+        s_node_pir_inject.latency = latency;
     }
-    s_node_pir_state = state;
+    return queued;
+}
 
+static void node_pir_inject_next(void *args) {
+    struct node_pir_inject *inject = &s_node_pir_inject;
+    node_pir_inject_edge(inject->edges[inject->next++] == '1');
+    if (inject->edges[inject->next] != '\0') {
+        nvk_sched_set(inject->gap, false, NVK_SCHED_GROUP_NODES, node_pir_inject_next, NULL);
+        return;
+    }
+    mg_rpc_send_responsef(inject->ri, PIR_INJECT_JSON_FMT, s_node_pir_accepted_edges - inject->accepted,
+                          s_node_pir_rejected_edges - inject->rejected, s_node_pir_dropped_edges - inject->dropped,
+                          s_node_pir_state, (long long) inject->latency);
+    free(inject->edges);
+    memset(inject, 0, sizeof(*inject));
     (void) args;
 }
 
+/* Nodes.PIR.Inject {edges: "1010", gap: 20} injects one edge per char spaced gap ms,
+ * the answer comes after the last one */
+void node_pir_rpc_inject_handler(struct mg_rpc_request_info *ri, const char *args,
+                           const char *src, void *user_data) {
+    char *edges = NULL;
+    int gap = 0;
+    json_scanf(args, strlen(args), "{edges: %Q, gap: %d}", &edges, &gap);
+    if (edges == NULL || *edges == '\0' || strlen(edges) > NODE_PIR_INJECT_MAX_EDGES || gap < 0) {
+        mg_rpc_send_errorf(ri, -1, "{error: \"Bad edges sequence\"}");
+        free(edges);
+        return;
+    }
+    if (s_node_pir_inject.edges != NULL) {
+        mg_rpc_send_errorf(ri, -1, "{error: \"Injection in progress\"}");
+        free(edges);
+        return;
+    }
+    struct node_pir_inject *inject = &s_node_pir_inject;
+    inject->ri = ri;
+    inject->edges = edges;
+    inject->gap = gap;
+    inject->accepted = s_node_pir_accepted_edges;
+    inject->rejected = s_node_pir_rejected_edges;
+    inject->dropped = s_node_pir_dropped_edges;
+    node_pir_inject_next(NULL);
+    (void) src;
+    (void) user_data;
+}
+
 bool node_pir_init() {
     bool enabled = mgos_sys_config_get_nodes_pir_enable();
     if(enabled) {
         int pin = mgos_sys_config_get_nodes_pir_pin();
         int sampling_interval = mgos_sys_config_get_nodes_pir_sampling_interval();
         mgos_gpio_set_mode(pin, MGOS_GPIO_MODE_INPUT);
-        node_pir_samp_int_timer_id = mgos_set_timer(sampling_interval, MGOS_TIMER_REPEAT, node_pir_sampling_handler, NULL);
+        if (mgos_sys_config_get_nodes_pir_irq_enable() &&
+            mgos_gpio_set_int_handler_isr(pin, MGOS_GPIO_INT_EDGE_ANY, node_pir_int_handler, NULL) &&
+            mgos_gpio_enable_int(pin)) {
+            s_node_pir_irq = true;
+            sampling_interval = mgos_sys_config_get_nodes_pir_sampling_fallback();
+        } else {
+            LOG(LL_INFO, ("PIR interrupts not available, polling every %d ms", sampling_interval));
+        }
+        node_pir_samp_int_timer_id = nvk_sched_set(sampling_interval, true, NVK_SCHED_GROUP_NODES, node_pir_sampling_handler, NULL);
+        if (mgos_sys_config_get_nodes_pir_inject()) {
+            // Test builds only, injected edges run the real motion path and its MQTT alerts
+            mgos_rpc_add_handler(PIR_RPC_INJECT_METHOD_NAME, node_pir_rpc_inject_handler, NULL);
+        }
         node_pir_set_pir_toggle_handler(default_node_pir_toggle_handler);
     }
     return enabled;
-}
\ No newline at end of file
+}
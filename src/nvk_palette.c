@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include "mgos.h"
+#include "frozen.h"
+#include "nvk_palette.h"
+
+struct nvk_palette_def {
+    const char *name;
+    const char *stops; // Built-in
+};
+
+static const struct nvk_palette_def NVK_PALETTE_DEFS[NVK_PALETTES] = {
+    { "rainbow", "0:ff0000,85:00ff00,170:0000ff,255:ff0000" },
+    { "heat", "0:000000,85:ff0000,170:ffff00,255:ffffff" },
+    { "strip", "0:ff0000,85:00ff00,170:0000ff,255:ff0000" }
+};
+
+static bool s_nvk_palette_strip = false;
+static uint32_t s_nvk_palette_generation = 0;
+
+static uint8_t s_nvk_palette_luts[NVK_PALETTES][256 * 3];
+
+const uint8_t *nvk_palette_lut(enum nvk_palette palette) {
+    return s_nvk_palette_luts[palette];
+}
+
+rgb_color nvk_palette_color(enum nvk_palette palette, uint8_t index) {
+    const uint8_t *c = s_nvk_palette_luts[palette] + index * 3;
+    rgb_color rgb = { c[0], c[1], c[2] };
+    return rgb;
+}
+
+/* Q16 position between two stops, rounded to the nearest channel value */
+static void nvk_palette_lerp(uint8_t *lut, int from, const uint8_t *a, int to, const uint8_t *b) {
+    for (int i = from; i <= to; i++) {
+        int32_t t = to > from ? ((i - from) << 16) / (to - from) : 0;
+        for (int ch = 0; ch < 3; ch++) {
+            lut[i * 3 + ch] = (uint8_t) (a[ch] + (((b[ch] - a[ch]) * t + 0x8000) >> 16));
+        }
+    }
+}
+
+bool nvk_palette_set(enum nvk_palette palette, const char *stops) {
+    int index[NVK_PALETTE_STOPS];
+    uint8_t rgb[NVK_PALETTE_STOPS][3];
+    int count = 0;
+    const char *p = stops;
+    while (p != NULL && *p != '\0') {
+        char *end;
+        if (!isdigit((unsigned char) *p)) {
+            return false;
+        }
+        long i = strtol(p, &end, 10);
+        if (end == p || *end != ':' || count == NVK_PALETTE_STOPS || i < 0 || i > 255 ||
+            (count > 0 && i <= index[count - 1])) {
+            return false;
+        }
+        p = end + 1;
+        if (!isxdigit((unsigned char) *p)) {
+            return false;
+        }
+        long hex = strtol(p, &end, 16);
+        if (end - p != 6 || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        index[count] = (int) i;
+        rgb[count][0] = (hex >> 16) & 0xFF;
+        rgb[count][1] = (hex >> 8) & 0xFF;
+        rgb[count][2] = hex & 0xFF;
+        count++;
+        p = *end == ',' ? end + 1 : end;
+    }
+    if (count == 0) {
+        return false;
+    }
+    uint8_t *lut = s_nvk_palette_luts[palette];
+    nvk_palette_lerp(lut, 0, rgb[0], index[0], rgb[0]);
+    for (int s = 1; s < count; s++) {
+        nvk_palette_lerp(lut, index[s - 1], rgb[s - 1], index[s], rgb[s]);
+    }
+    nvk_palette_lerp(lut, index[count - 1], rgb[count - 1], 255, rgb[count - 1]);
+    s_nvk_palette_generation++;
+    return true;
+}
+
+bool nvk_palette_init() {
+    const char *config[NVK_PALETTES] = {
+        mgos_sys_config_get_effects_palette_rainbow(),
+        mgos_sys_config_get_effects_palette_heat(),
+        mgos_sys_config_get_effects_palette_strip()
+    };
+    char *file[NVK_PALETTES] = { NULL };
+    char *json = json_fread(mgos_sys_config_get_effects_palette_file());
+    if (json != NULL) {
+        json_scanf(json, strlen(json), "{rainbow: %Q, heat: %Q, strip: %Q}",
+                   &file[NVK_PALETTE_RAINBOW], &file[NVK_PALETTE_HEAT], &file[NVK_PALETTE_STRIP]);
+        free(json);
+    }
+    bool ok = true;
+    for (int p = 0; p < NVK_PALETTES; p++) {
+        const char *stops = file[p] != NULL ? file[p] : config[p];
+        if (stops != NULL && *stops != '\0' && !nvk_palette_set((enum nvk_palette) p, stops)) {
+            LOG(LL_ERROR, ("Wrong %s palette: %s", NVK_PALETTE_DEFS[p].name, stops));
+            stops = NULL;
+            ok = false;
+        }
+        if (stops == NULL || *stops == '\0') {
+            nvk_palette_set((enum nvk_palette) p, NVK_PALETTE_DEFS[p].stops);
+        } else if (p == NVK_PALETTE_STRIP) {
+            s_nvk_palette_strip = true;
+        }
+        free(file[p]);
+    }
+    return ok;
+}
+
+uint32_t nvk_palette_generation() {
+    return s_nvk_palette_generation;
+}
+
+bool nvk_palette_strip() {
+    return s_nvk_palette_strip;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_particles.h"
+#include "nvk_fixed.h"
+#include "nvk_palette.h"
+
+#define PARTICLE_MIN_BRIGHTNESS 10
+
+/* Structure of arrays, live particles are packed in [0, count) */
+struct particles_pool {
+    int32_t pos[NVK_PARTICLES_MAX];
+    int16_t vel[NVK_PARTICLES_MAX];
+    uint8_t red[NVK_PARTICLES_MAX];
+    uint8_t green[NVK_PARTICLES_MAX];
+    uint8_t blue[NVK_PARTICLES_MAX];
+    uint8_t bright[NVK_PARTICLES_MAX];
+    uint8_t hold[NVK_PARTICLES_MAX];
+    uint8_t decay[NVK_PARTICLES_MAX];
+    int count;
+};
+
+static struct particles_pool s_particles = { 0 };
+
+void particles_reset() {
+    s_particles.count = 0;
+}
+
+int particles_count() {
+    return s_particles.count;
+}
+
+void *particles_state(size_t *size) {
+    *size = sizeof(s_particles);
+    return &s_particles;
+}
+
+int particles_spawn(int position, int velocity, int color, int hold, int decay) {
+    if (s_particles.count >= NVK_PARTICLES_MAX) {
+        return -1;
+    }
+    int i = s_particles.count++;
+    s_particles.pos[i] = position;
+    s_particles.vel[i] = velocity;
+    s_particles.red[i] = (color >> 16) & 0xFF;
+    s_particles.green[i] = (color >> 8) & 0xFF;
+    s_particles.blue[i] = color & 0xFF;
+    s_particles.bright[i] = 255;
+    s_particles.hold[i] = hold > 255 ? 255 : hold;
+    s_particles.decay[i] = decay < 0 ? 0 : (decay > 255 ? 255 : decay);
+    return i;
+}
+
+void particles_emit(const struct particle_emitter *e, int num_pixels) {
+    int budget = e->rate;
+    for (; budget > 0; budget -= 256) {
+        if (budget < 256 && (int) mgos_rand_range(0, 256) >= budget) {
+            break;
+        }
+        int position = e->position;
+        if (position == NVK_PARTICLES_RANDOM) {
+            position = (int) mgos_rand_range(0, num_pixels - 1) << 8;
+        }
+        int color = e->color;
+        if (color == NVK_PARTICLES_RANDOM) {
+            color = get_hex_color(mgos_rand_range(0, 254), mgos_rand_range(0, 254), mgos_rand_range(0, 254));
+        } else if (color == NVK_PARTICLES_PALETTE) {
+            rgb_color c = nvk_palette_color(NVK_PALETTE_STRIP, (uint8_t) mgos_rand_range(0, 255));
+            color = get_hex_color(c.red, c.green, c.blue);
+        }
+        int hold = e->hold_min;
+        if (e->hold_max > e->hold_min) {
+            hold = (int) mgos_rand_range(e->hold_min, e->hold_max);
+        }
+        if (particles_spawn(position, e->velocity, color, hold, e->decay) < 0) {
+            break;
+        }
+    }
+}
+
+static void particles_kill(int i) {
+    int last = --s_particles.count;
+    s_particles.pos[i] = s_particles.pos[last];
+    s_particles.vel[i] = s_particles.vel[last];
+    s_particles.red[i] = s_particles.red[last];
+    s_particles.green[i] = s_particles.green[last];
+    s_particles.blue[i] = s_particles.blue[last];
+    s_particles.bright[i] = s_particles.bright[last];
+    s_particles.hold[i] = s_particles.hold[last];
+    s_particles.decay[i] = s_particles.decay[last];
+}
+
+void particles_update(int num_pixels) {
+    int32_t limit = (int32_t) num_pixels << 8;
+    for (int i = 0; i < s_particles.count;) {
+        s_particles.pos[i] += s_particles.vel[i];
+        if (s_particles.hold[i] > 0) {
+            s_particles.hold[i]--;
+        } else {
+            // At least one step, a small decay would otherwise round to 0 and never end
+            int step = (s_particles.bright[i] * s_particles.decay[i]) >> 8;
+            s_particles.bright[i] -= step > 0 ? step : 1;
+        }
+        if (s_particles.bright[i] <= PARTICLE_MIN_BRIGHTNESS || s_particles.pos[i] < -256 || s_particles.pos[i] >= limit) {
+            particles_kill(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void particles_add(int pixel, int r, int g, int b, int scale) {
+    rgb_color c = node_neopixel_get_pixel_color(pixel);
+    node_neopixel_set(pixel, fixed_qadd8(c.red, (r * scale) >> 8), fixed_qadd8(c.green, (g * scale) >> 8),
+                      fixed_qadd8(c.blue, (b * scale) >> 8));
+}
+
+void particles_render(int num_pixels) {
+    for (int i = 0; i < s_particles.count; i++) {
+        int pixel = s_particles.pos[i] >> 8;
+        int frac = s_particles.pos[i] & 0xFF;
+        int bright = s_particles.bright[i] + 1;
+        int r = s_particles.red[i];
+        int g = s_particles.green[i];
+        int b = s_particles.blue[i];
+        // Split moving particles between the two pixels they straddle
+        if (pixel >= 0 && pixel < num_pixels) {
+            particles_add(pixel, r, g, b, (bright * (256 - frac)) >> 8);
+        }
+        if (frac != 0 && pixel + 1 >= 0 && pixel + 1 < num_pixels) {
+            particles_add(pixel + 1, r, g, b, (bright * frac) >> 8);
+        }
+    }
+}
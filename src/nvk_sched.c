@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "mgos_time.h"
+#include "mgos_timers.h"
+#include "mgos_rpc.h"
+#include "nvk_sched.h"
+
+#define NVK_SCHED_WHEEL_BITS 6
+#define NVK_SCHED_WHEEL_SLOTS (1 << NVK_SCHED_WHEEL_BITS)
+#define NVK_SCHED_WHEEL_MASK (NVK_SCHED_WHEEL_SLOTS - 1)
+#define NVK_SCHED_LEVELS 3
+#define NVK_SCHED_MAX_DELTA ((1 << (NVK_SCHED_WHEEL_BITS * NVK_SCHED_LEVELS)) - 1)
+#define NVK_SCHED_LISTS (NVK_SCHED_LEVELS * NVK_SCHED_WHEEL_SLOTS + 1)
+#define NVK_SCHED_RUNNING_LIST (NVK_SCHED_LISTS - 1)
+#define NVK_SCHED_NONE -1
+
+struct nvk_sched_task {
+    nvk_sched_cb_t cb;
+    void *arg;
+    uint32_t expires; // Absolute tick
+    uint32_t period; // Ticks, 0 for one-shot
+    uint16_t generation;
+    uint8_t group;
+    bool active;
+    int16_t list; // Wheel slot or running list the task is linked in
+    int16_t prev;
+    int16_t next;
+    uint32_t overruns; // Periods skipped because the task ran late
+};
+
+static struct nvk_sched_task s_nvk_sched_tasks[NVK_SCHED_MAX_TASKS];
+static int16_t s_nvk_sched_lists[NVK_SCHED_LISTS];
+static uint32_t s_nvk_sched_tick = 0;
+static uint32_t s_nvk_sched_target = 0; // Tick matching the real uptime, ahead of s_nvk_sched_tick while catching up
+static int s_nvk_sched_tick_ms = 10;
+static int64_t s_nvk_sched_start = 0;
+static mgos_timer_id s_nvk_sched_timer_id = MGOS_INVALID_TIMER_ID;
+
+static int s_nvk_sched_active = 0;
+static int s_nvk_sched_max_active = 0;
+static uint32_t s_nvk_sched_late_ticks = 0;
+static uint32_t s_nvk_sched_overruns = 0;
+static uint32_t s_nvk_sched_full = 0;
+
+static void nvk_sched_unlink(int i) {
+    struct nvk_sched_task *t = &s_nvk_sched_tasks[i];
+    if (t->prev != NVK_SCHED_NONE) {
+        s_nvk_sched_tasks[t->prev].next = t->next;
+    } else {
+        s_nvk_sched_lists[t->list] = t->next;
+    }
+    if (t->next != NVK_SCHED_NONE) {
+        s_nvk_sched_tasks[t->next].prev = t->prev;
+    }
+    t->list = NVK_SCHED_NONE;
+}
+
+static void nvk_sched_link(int i, int list) {
+    struct nvk_sched_task *t = &s_nvk_sched_tasks[i];
+    t->list = list;
+    t->prev = NVK_SCHED_NONE;
+    t->next = s_nvk_sched_lists[list];
+    if (t->next != NVK_SCHED_NONE) {
+        s_nvk_sched_tasks[t->next].prev = i;
+    }
+    s_nvk_sched_lists[list] = i;
+}
+
+/* Place a task in the level whose span covers its remaining delay */
+static void nvk_sched_insert(int i) {
+    struct nvk_sched_task *t = &s_nvk_sched_tasks[i];
+    int32_t delta = (int32_t) (t->expires - s_nvk_sched_tick);
+    uint32_t at = t->expires;
+    if (delta < 0) {
+        at = s_nvk_sched_tick;
+        delta = 0;
+    } else if (delta > NVK_SCHED_MAX_DELTA) {
+        at = s_nvk_sched_tick + NVK_SCHED_MAX_DELTA;
+        delta = NVK_SCHED_MAX_DELTA;
+    }
+    int level = 0;
+    while (level < NVK_SCHED_LEVELS - 1 && delta >= (1 << (NVK_SCHED_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    int slot = (at >> (NVK_SCHED_WHEEL_BITS * level)) & NVK_SCHED_WHEEL_MASK;
+    nvk_sched_link(i, level * NVK_SCHED_WHEEL_SLOTS + slot);
+}
+
+static void nvk_sched_release(int i) {
+    struct nvk_sched_task *t = &s_nvk_sched_tasks[i];
+    if (t->list != NVK_SCHED_NONE) {
+        nvk_sched_unlink(i);
+    }
+    t->active = false;
+    t->generation++;
+    s_nvk_sched_active--;
+}
+
+static nvk_sched_id nvk_sched_make_id(int i) {
+    return ((uint32_t) s_nvk_sched_tasks[i].generation << 8) | (uint32_t) (i + 1);
+}
+
+static int nvk_sched_find(nvk_sched_id id) {
+    int i = (int) (id & 0xFF) - 1;
+    if (id == NVK_SCHED_INVALID_ID || i < 0 || i >= NVK_SCHED_MAX_TASKS) {
+        return NVK_SCHED_NONE;
+    }
+    struct nvk_sched_task *t = &s_nvk_sched_tasks[i];
+    if (!t->active || nvk_sched_make_id(i) != id) {
+        return NVK_SCHED_NONE;
+    }
+    return i;
+}
+
+nvk_sched_id nvk_sched_set(int msecs, bool repeat, enum nvk_sched_group group, nvk_sched_cb_t cb, void *arg) {
+    for (int i = 0; i < NVK_SCHED_MAX_TASKS; i++) {
+        struct nvk_sched_task *t = &s_nvk_sched_tasks[i];
+        if (t->active) {
+            continue;
+        }
+        uint32_t ticks = (msecs + s_nvk_sched_tick_ms - 1) / s_nvk_sched_tick_ms;
+        if (ticks == 0) {
+            ticks = 1;
+        }
+        t->cb = cb;
+        t->arg = arg;
+        t->expires = s_nvk_sched_tick + ticks;
+        t->period = repeat ? ticks : 0;
+        t->group = group;
+        t->active = true;
+        t->overruns = 0;
+        nvk_sched_insert(i);
+        if (++s_nvk_sched_active > s_nvk_sched_max_active) {
+            s_nvk_sched_max_active = s_nvk_sched_active;
+        }
+        return nvk_sched_make_id(i);
+    }
+    s_nvk_sched_full++;
+    LOG(LL_ERROR, ("Scheduler full, task dropped"));
+    return NVK_SCHED_INVALID_ID;
+}
+
+bool nvk_sched_clear(nvk_sched_id id) {
+    int i = nvk_sched_find(id);
+    if (i == NVK_SCHED_NONE) {
+        return false;
+    }
+    nvk_sched_release(i);
+    return true;
+}
+
+int nvk_sched_clear_group(enum nvk_sched_group group) {
+    int n = 0;
+    for (int i = 0; i < NVK_SCHED_MAX_TASKS; i++) {
+        if (s_nvk_sched_tasks[i].active && s_nvk_sched_tasks[i].group == group) {
+            nvk_sched_release(i);
+            n++;
+        }
+    }
+    return n;
+}
+
+static void nvk_sched_cascade(int level) {
+    int slot = (s_nvk_sched_tick >> (NVK_SCHED_WHEEL_BITS * level)) & NVK_SCHED_WHEEL_MASK;
+    int list = level * NVK_SCHED_WHEEL_SLOTS + slot;
+    int i;
+    while ((i = s_nvk_sched_lists[list]) != NVK_SCHED_NONE) {
+        nvk_sched_unlink(i);
+        nvk_sched_insert(i);
+    }
+}
+
+static void nvk_sched_run_tick() {
+    s_nvk_sched_tick++;
+    for (int level = 1; level < NVK_SCHED_LEVELS; level++) {
+        if ((s_nvk_sched_tick & ((1 << (NVK_SCHED_WHEEL_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        nvk_sched_cascade(level);
+    }
+
+    // Move due tasks to the running list so callbacks can set/clear any task
+    int list = s_nvk_sched_tick & NVK_SCHED_WHEEL_MASK;
+    int i;
+    while ((i = s_nvk_sched_lists[list]) != NVK_SCHED_NONE) {
+        nvk_sched_unlink(i);
+        nvk_sched_link(i, NVK_SCHED_RUNNING_LIST);
+    }
+    while ((i = s_nvk_sched_lists[NVK_SCHED_RUNNING_LIST]) != NVK_SCHED_NONE) {
+        struct nvk_sched_task *t = &s_nvk_sched_tasks[i];
+        nvk_sched_unlink(i);
+        if ((int32_t) (t->expires - s_nvk_sched_tick) > 0) {
+            nvk_sched_insert(i); // Clamped long delay, not due yet
+            continue;
+        }
+        nvk_sched_id id = nvk_sched_make_id(i);
+        t->cb(t->arg);
+        if (nvk_sched_find(id) != i) {
+            continue; // Cleared by its own callback
+        }
+        if (t->period == 0) {
+            nvk_sched_release(i);
+            continue;
+        }
+        // Periods already behind the real time are skipped, not replayed in a burst
+        t->expires += t->period;
+        if ((int32_t) (t->expires - s_nvk_sched_target) <= 0) {
+            uint32_t missed = (s_nvk_sched_target - t->expires) / t->period + 1;
+            t->overruns += missed;
+            s_nvk_sched_overruns += missed;
+            t->expires += missed * t->period;
+        }
+        nvk_sched_insert(i);
+    }
+}
+
+/* The only mgos timer of the driver, catches up if the loop was stalled */
+static void nvk_sched_tick_handler(void *args) {
+    int64_t elapsed = (mgos_uptime_micros() - s_nvk_sched_start) / 1000;
+    s_nvk_sched_target = (uint32_t) (elapsed / s_nvk_sched_tick_ms);
+    int32_t behind = (int32_t) (s_nvk_sched_target - s_nvk_sched_tick);
+    if (behind > 1) {
+        s_nvk_sched_late_ticks += behind - 1;
+    }
+    while ((int32_t) (s_nvk_sched_target - s_nvk_sched_tick) > 0) {
+        nvk_sched_run_tick();
+    }
+    (void) args;
+}
+
+void nvk_sched_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args,
+                           const char *src, void *user_data) {
+    mg_rpc_send_responsef(ri, "{tick:%u,tick_ms:%d,active:%d,max_active:%d,capacity:%d,late_ticks:%u,overruns:%u,full:%u}",
+                          s_nvk_sched_tick, s_nvk_sched_tick_ms, s_nvk_sched_active, s_nvk_sched_max_active,
+                          NVK_SCHED_MAX_TASKS, s_nvk_sched_late_ticks, s_nvk_sched_overruns, s_nvk_sched_full);
+    (void) args;
+    (void) src;
+    (void) user_data;
+}
+
+bool nvk_sched_init() {
+    if (s_nvk_sched_timer_id != MGOS_INVALID_TIMER_ID) {
+        return true;
+    }
+    for (int l = 0; l < NVK_SCHED_LISTS; l++) {
+        s_nvk_sched_lists[l] = NVK_SCHED_NONE;
+    }
+    for (int i = 0; i < NVK_SCHED_MAX_TASKS; i++) {
+        s_nvk_sched_tasks[i].list = NVK_SCHED_NONE;
+        s_nvk_sched_tasks[i].generation = 1;
+    }
+    s_nvk_sched_tick_ms = mgos_sys_config_get_app_sched_tick();
+    if (s_nvk_sched_tick_ms <= 0) {
+        s_nvk_sched_tick_ms = 10;
+    }
+    s_nvk_sched_start = mgos_uptime_micros();
+    s_nvk_sched_timer_id = mgos_set_timer(s_nvk_sched_tick_ms, MGOS_TIMER_REPEAT, nvk_sched_tick_handler, NULL);
+    return s_nvk_sched_timer_id != MGOS_INVALID_TIMER_ID;
+}
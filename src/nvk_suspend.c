@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "nvk_nodes_neopixel.h"
+#include "nvk_suspend.h"
+
+struct nvk_suspend_slot {
+    int key;
+    uint32_t stamp; // Save order, the lowest is replaced first
+    uint8_t *data; // Regions back to back, then the frame as r, g, b
+    size_t len;
+    int pixels;
+};
+
+static struct nvk_suspend_slot s_nvk_suspend_slots[NVK_SUSPEND_SLOTS];
+static uint32_t s_nvk_suspend_stamp = 0;
+
+/* Streamed strips keep no frame to copy */
+static int nvk_suspend_frame_pixels() {
+    return node_neopixel_streaming() ? 0 : mgos_sys_config_get_nodes_neopixel_pixels();
+}
+
+static size_t nvk_suspend_regions_size(const struct nvk_suspend_region *regions, int count) {
+    size_t size = 0;
+    for (int r = 0; r < count; r++) {
+        size += regions[r].size;
+    }
+    return size;
+}
+
+static struct nvk_suspend_slot *nvk_suspend_find(int key) {
+    for (int s = 0; s < NVK_SUSPEND_SLOTS; s++) {
+        if (s_nvk_suspend_slots[s].data != NULL && s_nvk_suspend_slots[s].key == key) {
+            return &s_nvk_suspend_slots[s];
+        }
+    }
+    return NULL;
+}
+
+void nvk_suspend_drop(int key) {
+    struct nvk_suspend_slot *slot = nvk_suspend_find(key);
+    if (slot != NULL) {
+        free(slot->data);
+        memset(slot, 0, sizeof(*slot));
+    }
+}
+
+bool nvk_suspend_saved(int key) {
+    return nvk_suspend_find(key) != NULL;
+}
+
+bool nvk_suspend_save(int key, const struct nvk_suspend_region *regions, int count) {
+    nvk_suspend_drop(key);
+    struct nvk_suspend_slot *slot = &s_nvk_suspend_slots[0];
+    for (int s = 1; s < NVK_SUSPEND_SLOTS && slot->data != NULL; s++) {
+        if (s_nvk_suspend_slots[s].data == NULL || s_nvk_suspend_slots[s].stamp < slot->stamp) {
+            slot = &s_nvk_suspend_slots[s];
+        }
+    }
+    free(slot->data);
+    int pixels = nvk_suspend_frame_pixels();
+    size_t state = nvk_suspend_regions_size(regions, count);
+    slot->data = (uint8_t *) malloc(state + pixels * 3);
+    if (slot->data == NULL) {
+        memset(slot, 0, sizeof(*slot));
+        return false;
+    }
+    slot->key = key;
+    slot->stamp = ++s_nvk_suspend_stamp;
+    slot->len = state;
+    slot->pixels = pixels;
+    uint8_t *p = slot->data;
+    for (int r = 0; r < count; r++) {
+        memcpy(p, regions[r].ptr, regions[r].size);
+        p += regions[r].size;
+    }
+    for (int i = 0; i < pixels; i++, p += 3) {
+        rgb_color c = node_neopixel_get_pixel_color(i);
+        p[0] = c.red;
+        p[1] = c.green;
+        p[2] = c.blue;
+    }
+    return true;
+}
+
+bool nvk_suspend_restore(int key, const struct nvk_suspend_region *regions, int count) {
+    struct nvk_suspend_slot *slot = nvk_suspend_find(key);
+    if (slot == NULL) {
+        return false;
+    }
+    // A different strip length or state layout can not be continued
+    if (slot->pixels != nvk_suspend_frame_pixels() ||
+        slot->len != nvk_suspend_regions_size(regions, count)) {
+        nvk_suspend_drop(key);
+        return false;
+    }
+    const uint8_t *p = slot->data;
+    for (int r = 0; r < count; r++) {
+        memcpy(regions[r].ptr, p, regions[r].size);
+        p += regions[r].size;
+    }
+    for (int i = 0; i < slot->pixels; i++, p += 3) {
+        node_neopixel_set(i, p[0], p[1], p[2]);
+    }
+    if (slot->pixels > 0) {
+        node_neopixel_show();
+    }
+    nvk_suspend_drop(key);
+    return true;
+}
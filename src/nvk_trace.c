@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos.h"
+#include "mgos_time.h"
+#include "mgos_rpc.h"
+#include "frozen.h"
+#include "nvk_trace.h"
+
+struct nvk_trace {
+    uint32_t stages[NVK_TRACE_STAGES]; // Offset from the edge (us), 0 if not reached
+};
+
+static struct nvk_trace s_nvk_trace_history[NVK_TRACE_HISTORY];
+static int s_nvk_trace_count = 0;
+static int s_nvk_trace_next = 0;
+
+static struct nvk_trace s_nvk_trace_current;
+static int64_t s_nvk_trace_edge_time = 0;
+static bool s_nvk_trace_open = false;
+
+static const char *NVK_TRACE_STAGE_NAMES[NVK_TRACE_STAGES] = {
+    "edge", "toggle", "motion", "dark", "ramp", "show"
+};
+
+void nvk_trace_begin(int64_t edge_time) {
+    if (s_nvk_trace_open) {
+        nvk_trace_end();
+    }
+    memset(&s_nvk_trace_current, 0, sizeof(s_nvk_trace_current));
+    s_nvk_trace_edge_time = edge_time > 0 ? edge_time : mgos_uptime_micros();
+    s_nvk_trace_open = true;
+}
+
+void nvk_trace_stamp(enum nvk_trace_stage stage) {
+    if (!s_nvk_trace_open || stage <= NVK_TRACE_EDGE || stage >= NVK_TRACE_STAGES) {
+        return;
+    }
+    if (s_nvk_trace_current.stages[stage] == 0) {
+        int64_t offset = mgos_uptime_micros() - s_nvk_trace_edge_time;
+        s_nvk_trace_current.stages[stage] = offset > 0 ? (uint32_t) offset : 1;
+    }
+    if (stage == NVK_TRACE_SHOW) {
+        nvk_trace_end();
+    }
+}
+
+void nvk_trace_end() {
+    if (!s_nvk_trace_open) {
+        return;
+    }
+    s_nvk_trace_open = false;
+    s_nvk_trace_history[s_nvk_trace_next] = s_nvk_trace_current;
+    s_nvk_trace_next = (s_nvk_trace_next + 1) % NVK_TRACE_HISTORY;
+    if (s_nvk_trace_count < NVK_TRACE_HISTORY) {
+        s_nvk_trace_count++;
+    }
+}
+
+bool nvk_trace_is_open() {
+    return s_nvk_trace_open;
+}
+
+/* Sorts the reached offsets of a stage and returns how many there are */
+static int nvk_trace_collect(enum nvk_trace_stage stage, uint32_t *values) {
+    int n = 0;
+    for (int i = 0; i < s_nvk_trace_count; i++) {
+        uint32_t v = s_nvk_trace_history[i].stages[stage];
+        if (v == 0) {
+            continue;
+        }
+        int j = n++;
+        for (; j > 0 && values[j - 1] > v; j--) {
+            values[j] = values[j - 1];
+        }
+        values[j] = v;
+    }
+    return n;
+}
+
+static uint32_t nvk_trace_percentile(const uint32_t *values, int n, int p) {
+    int rank = (p * n + 99) / 100;
+    return values[rank > 0 ? rank - 1 : 0];
+}
+
+static int nvk_trace_json_stages(struct json_out *out, va_list *ap) {
+    uint32_t values[NVK_TRACE_HISTORY];
+    int len = 0;
+    for (int s = NVK_TRACE_TOGGLE; s < NVK_TRACE_STAGES; s++) {
+        int n = nvk_trace_collect(s, values);
+        if (s > NVK_TRACE_TOGGLE) {
+            len += json_printf(out, ",");
+        }
+        len += json_printf(out, "%Q:", NVK_TRACE_STAGE_NAMES[s]);
+        if (n == 0) {
+            len += json_printf(out, "{n:0}");
+            continue;
+        }
+        len += json_printf(out, "{n:%d,p50:%u,p90:%u,p99:%u,max:%u}", n,
+                           nvk_trace_percentile(values, n, 50), nvk_trace_percentile(values, n, 90),
+                           nvk_trace_percentile(values, n, 99), values[n - 1]);
+    }
+    (void) ap;
+    return len;
+}
+
+/* Driver.Trace: per stage percentiles (us from the PIR edge) over the last traces */
+void nvk_trace_rpc_stat_handler(struct mg_rpc_request_info *ri, const char *args,
+                           const char *src, void *user_data) {
+    mg_rpc_send_responsef(ri, "{count:%d,stages:{%M}}", s_nvk_trace_count, nvk_trace_json_stages);
+    (void) args;
+    (void) src;
+    (void) user_data;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include "mgos.h"
+#include "mgos_http_server.h"
+#include "common/cs_crc32.h"
+#include "nvk_web.h"
+
+#define NVK_WEB_MAX_NAME 48
+#define NVK_WEB_MAX_PATH 64
+#define NVK_WEB_ETAGS 24
+#define NVK_WEB_CHUNK 512
+
+struct nvk_web_etag {
+    char name[NVK_WEB_MAX_NAME];
+    char etag[12]; // "xxxxxxxx" with quotes
+};
+
+struct nvk_web_type {
+    const char *ext;
+    const char *mime;
+};
+
+/* Only what tools/build_web.py writes is served, config and data files on fs are not */
+static const struct nvk_web_type NVK_WEB_TYPES[] = {
+    { ".html", "text/html; charset=utf-8" },
+    { ".css", "text/css" },
+    { ".js", "application/javascript" },
+    { ".woff2", "font/woff2" }
+};
+
+static struct nvk_web_etag s_nvk_web_etags[NVK_WEB_ETAGS];
+static int s_nvk_web_etags_next = 0;
+
+/* Maps the request uri to a file name of the flat fs, "/" is index.html */
+static bool nvk_web_name(const struct mg_str *uri, char *name) {
+    const char *p = uri->p;
+    size_t len = uri->len;
+    if (len > 0 && *p == '/') {
+        p++;
+        len--;
+    }
+    if (len == 0) {
+        strcpy(name, "index.html");
+        return true;
+    }
+    if (len >= NVK_WEB_MAX_NAME || memchr(p, '/', len) != NULL || (len >= 2 && p[0] == '.' && p[1] == '.')) {
+        return false;
+    }
+    memcpy(name, p, len);
+    name[len] = '\0';
+    return true;
+}
+
+static const char *nvk_web_mime(const char *name) {
+    const char *ext = strrchr(name, '.');
+    for (size_t t = 0; ext != NULL && t < sizeof(NVK_WEB_TYPES) / sizeof(NVK_WEB_TYPES[0]); t++) {
+        if (strcmp(ext, NVK_WEB_TYPES[t].ext) == 0) {
+            return NVK_WEB_TYPES[t].mime;
+        }
+    }
+    return NULL;
+}
+
+/* CRC of the stored bytes, computed on the first request of each file */
+static const char *nvk_web_etag(const char *name, FILE *fp) {
+    for (int e = 0; e < NVK_WEB_ETAGS; e++) {
+        if (strcmp(s_nvk_web_etags[e].name, name) == 0) {
+            return s_nvk_web_etags[e].etag;
+        }
+    }
+    uint8_t buf[128];
+    uint32_t crc = 0;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        crc = cs_crc32(crc, buf, n);
+    }
+    rewind(fp);
+    struct nvk_web_etag *e = &s_nvk_web_etags[s_nvk_web_etags_next];
+    s_nvk_web_etags_next = (s_nvk_web_etags_next + 1) % NVK_WEB_ETAGS;
+    strcpy(e->name, name);
+    snprintf(e->etag, sizeof(e->etag), "\"%08x\"", (unsigned int) crc);
+    return e->etag;
+}
+
+/* Keeps a couple of chunks queued until the file is sent */
+static void nvk_web_send_handler(struct mg_connection *nc, int ev, void *ev_data, void *user_data) {
+    FILE *fp = (FILE *) user_data;
+    if (fp == NULL) {
+        return;
+    }
+    if (ev == MG_EV_CLOSE) {
+        fclose(fp);
+        nc->user_data = NULL;
+        return;
+    }
+    if (ev != MG_EV_SEND && ev != MG_EV_POLL) {
+        return;
+    }
+    char buf[NVK_WEB_CHUNK];
+    while (nc->send_mbuf.len < 2 * NVK_WEB_CHUNK) {
+        size_t n = fread(buf, 1, sizeof(buf), fp);
+        if (n > 0) {
+            mg_send(nc, buf, n);
+        }
+        if (n < sizeof(buf)) {
+            fclose(fp);
+            nc->user_data = NULL;
+            nc->flags |= MG_F_SEND_AND_CLOSE;
+            break;
+        }
+    }
+    (void) ev_data;
+}
+
+static void nvk_web_handler(struct mg_connection *nc, int ev, void *ev_data, void *user_data) {
+    if (ev != MG_EV_HTTP_REQUEST) {
+        return;
+    }
+    struct http_message *hm = (struct http_message *) ev_data;
+    char name[NVK_WEB_MAX_NAME];
+    char path[NVK_WEB_MAX_PATH];
+    if (!nvk_web_name(&hm->uri, name) || nvk_web_mime(name) == NULL) {
+        mg_http_send_error(nc, 404, NULL);
+        return;
+    }
+    const char *root = mgos_sys_config_get_http_document_root();
+    const char *sep = root[strlen(root) - 1] == '/' ? "" : "/";
+    snprintf(path, sizeof(path), "%s%s%s.gz", root, sep, name);
+    bool gzip = true;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        // Binary assets are stored as they are
+        path[strlen(path) - 3] = '\0';
+        gzip = false;
+        fp = fopen(path, "rb");
+    }
+    if (fp == NULL) {
+        mg_http_send_error(nc, 404, NULL);
+        return;
+    }
+
+    const char *etag = nvk_web_etag(name, fp);
+    // Pages keep their names, everything else is named after its content
+    bool page = strcmp(nvk_web_mime(name), NVK_WEB_TYPES[0].mime) == 0;
+    char cache[48];
+    if (page) {
+        strcpy(cache, "no-cache");
+    } else {
+        snprintf(cache, sizeof(cache), "public, max-age=%d, immutable", mgos_sys_config_get_app_web_max_age());
+    }
+    char headers[192];
+    snprintf(headers, sizeof(headers), "Content-Type: %s\r\nETag: %s\r\nCache-Control: %s%s\r\nConnection: close",
+             nvk_web_mime(name), etag, cache, gzip ? "\r\nContent-Encoding: gzip" : "");
+
+    struct mg_str *match = mg_get_http_header(hm, "If-None-Match");
+    if (match != NULL && mg_vcmp(match, etag) == 0) {
+        fclose(fp);
+        mg_send_head(nc, 304, 0, headers);
+        nc->flags |= MG_F_SEND_AND_CLOSE;
+        return;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    mg_send_head(nc, 200, size, headers);
+    nc->handler = nvk_web_send_handler;
+    nc->user_data = fp;
+    nvk_web_send_handler(nc, MG_EV_SEND, NULL, fp);
+    (void) user_data;
+}
+
+bool nvk_web_init() {
+    if (!mgos_sys_config_get_app_web_enable()) {
+        return false;
+    }
+    return mgos_register_http_endpoint("/", nvk_web_handler, NULL);
+}
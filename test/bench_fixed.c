@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark of the effect frames moved to nvk_fixed.h, each one
+ * against the per-pixel division code it replaced. The effects are the
+ * real headers drawing into a plain buffer, so only their maths is timed.
+ * A host CPU divides in hardware, the gap on the ESP8266 is wider, see
+ * Driver.MathBench for numbers on the device.
+ *   make -C test bench
+ */
+
+#include <time.h>
+#include "mgos.h"
+#include "effect_rainbow.h"
+#include "effect_cylon.h"
+#include "effect_audio.h"
+#include "effect_snow.h"
+
+#define BENCH_PIXELS 300
+#define BENCH_FRAMES 20000
+
+static uint8_t s_bench_frame[BENCH_PIXELS * 3];
+static struct audio_frame s_bench_audio = { 200, { 255, 200, 150, 120, 90, 60, 30, 10 }, false, 0 };
+
+int mgos_sys_config_get_nodes_neopixel_pixels(void) {
+    return BENCH_PIXELS;
+}
+
+int mgos_sys_config_get_strip_speed(void) {
+    return 50;
+}
+
+int mgos_sys_config_get_effects_cylon_size(void) {
+    return 4;
+}
+
+const char *mgos_sys_config_get_effects_palette_rainbow(void) {
+    return "";
+}
+
+const char *mgos_sys_config_get_effects_palette_heat(void) {
+    return "";
+}
+
+const char *mgos_sys_config_get_effects_palette_strip(void) {
+    return "";
+}
+
+const char *mgos_sys_config_get_effects_palette_file(void) {
+    return "";
+}
+
+char *json_fread(const char *path) {
+    return NULL;
+}
+
+int json_scanf(const char *str, int str_len, const char *fmt, ...) {
+    return 0;
+}
+
+int64_t mgos_uptime_micros(void) {
+    return 0;
+}
+
+uint32_t mgos_rand_range(float from, float to) {
+    return (uint32_t) from;
+}
+
+int32_t nvk_clock_frame(int32_t *counter, int period_ms) {
+    return (*counter)++;
+}
+
+bool audio_process(struct audio_frame *frame) {
+    *frame = s_bench_audio;
+    return true;
+}
+
+rgb_color get_rgb_color(int hex) {
+    rgb_color c = { (hex >> 16) & 0xFF, (hex >> 8) & 0xFF, hex & 0xFF };
+    return c;
+}
+
+void node_neopixel_set(int pixel, int r, int g, int b) {
+    if (pixel >= 0 && pixel < BENCH_PIXELS) {
+        s_bench_frame[pixel * 3] = r;
+        s_bench_frame[pixel * 3 + 1] = g;
+        s_bench_frame[pixel * 3 + 2] = b;
+    }
+}
+
+void node_neopixe_set_all(int r, int g, int b) {
+    for (int p = 0; p < BENCH_PIXELS; p++) {
+        node_neopixel_set(p, r, g, b);
+    }
+}
+
+void node_neopixel_set_all_pixels(rgb_color c) {
+    node_neopixe_set_all(c.red, c.green, c.blue);
+}
+
+void node_neopixel_show() {
+}
+
+void node_neopixel_stream(node_neopixel_tile_render render, void *arg) {
+    rgb_color tile[BENCH_PIXELS];
+    render(0, BENCH_PIXELS, tile, arg);
+    node_neopixel_set(0, tile[0].red, tile[0].green, tile[0].blue);
+}
+
+/* The frames as they were before nvk_fixed.h */
+
+static void before_rainbow_cycle_tile(int first, int count, rgb_color *out, void *arg) {
+    int i = *(int *) arg;
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    for (int p = 0; p < count; p++) {
+        int k = (first + p) * 256 / num_pixels;
+        out[p] = nvk_palette_color(NVK_PALETTE_RAINBOW, (k + i) & 255);
+    }
+}
+
+static void before_cylon(rgb_color c, int p, int eye_size) {
+    int r = c.red / 10;
+    int g = c.green / 10;
+    int b = c.blue / 10;
+    node_neopixe_set_all(0, 0, 0);
+    node_neopixel_set(p, r, g, b);
+    for (int i = 1; i <= eye_size; i++) {
+        node_neopixel_set(p + i, c.red, c.green, c.blue);
+    }
+    node_neopixel_set(p + eye_size + 1, r, g, b);
+}
+
+static void before_vu(const struct audio_frame *f) {
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    int lit = f->level * num_pixels / 255;
+    for (int p = 0; p < num_pixels; p++) {
+        if (p < lit) {
+            int r = p * 255 / num_pixels;
+            node_neopixel_set(p, r, 255 - r, 0);
+        } else {
+            node_neopixel_set(p, 0, 0, 0);
+        }
+    }
+}
+
+static void before_spectrum(const struct audio_frame *f) {
+    int num_pixels = mgos_sys_config_get_nodes_neopixel_pixels();
+    for (int p = 0; p < num_pixels; p++) {
+        int b = p * NVK_AUDIO_BANDS / num_pixels;
+        int v = f->bands[b] + 1;
+        rgb_color c = s_audio_band_colors[b];
+        node_neopixel_set(p, (c.red * v) >> 8, (c.green * v) >> 8, (c.blue * v) >> 8);
+    }
+}
+
+static void before_snow_levels() {
+    for (int p = 0; p < BENCH_PIXELS; p++) {
+        int level = p & 0xFF;
+        int v = SNOW_BASE_LEVEL + ((255 - SNOW_BASE_LEVEL) * level) / 255;
+        node_neopixel_set(p, v, v, v);
+    }
+}
+
+static void after_snow_levels() {
+    for (int p = 0; p < BENCH_PIXELS; p++) {
+        snow_set_level(p, p & 0xFF);
+    }
+}
+
+static double bench_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench_report(const char *name, double before, double after) {
+    printf("%-14s before %7.3f us  after %7.3f us  per frame of %d pixels\n", name,
+           before / BENCH_FRAMES, after / BENCH_FRAMES, BENCH_PIXELS);
+}
+
+int main() {
+    nvk_palette_init();
+    rgb_color tile[BENCH_PIXELS];
+    neopixel_effect_data cylon = { 0xFF8020 };
+    double start, before;
+
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        before_rainbow_cycle_tile(0, BENCH_PIXELS, tile, &i);
+        s_bench_frame[0] += tile[i % BENCH_PIXELS].red;
+    }
+    before = bench_now_us() - start;
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        rainbow_cycle_tile(0, BENCH_PIXELS, tile, &i);
+        s_bench_frame[0] += tile[i % BENCH_PIXELS].red;
+    }
+    bench_report("rainbow cycle", before, bench_now_us() - start);
+
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        before_cylon(get_rgb_color(cylon.color), i % (BENCH_PIXELS - 6), 4);
+    }
+    before = bench_now_us() - start;
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        cylon_effect(&cylon);
+    }
+    bench_report("cylon", before, bench_now_us() - start);
+
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        before_vu(&s_bench_audio);
+    }
+    before = bench_now_us() - start;
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        audio_vu_effect(NULL);
+    }
+    bench_report("audio VU", before, bench_now_us() - start);
+
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        before_spectrum(&s_bench_audio);
+    }
+    before = bench_now_us() - start;
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        audio_spectrum_effect(NULL);
+    }
+    bench_report("audio spectrum", before, bench_now_us() - start);
+
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        before_snow_levels();
+    }
+    before = bench_now_us() - start;
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        after_snow_levels();
+    }
+    bench_report("snow levels", before, bench_now_us() - start);
+    return 0;
+}
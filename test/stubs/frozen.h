@@ -0,0 +1,4 @@
+#pragma once
+
+int json_scanf(const char *str, int str_len, const char *fmt, ...);
+char *json_fread(const char *path);
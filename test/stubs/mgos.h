@@ -0,0 +1,29 @@
+/* Host stand-in for the parts of mgos.h the tested modules use */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mgos_sys_config.h"
+
+#define IRAM
+enum { LL_NONE = -1, LL_ERROR, LL_WARN, LL_INFO, LL_DEBUG, LL_VERBOSE_DEBUG };
+/* Quiet unless TEST_LOG is set, the tests provoke errors on purpose */
+#define LOG(l, x) do { (void) (l); if (getenv("TEST_LOG") != NULL) { printf x; printf("\n"); } } while (0)
+
+double mgos_uptime(void);
+int64_t mgos_uptime_micros(void);
+uint32_t mgos_rand_range(float from, float to);
+
+enum mgos_gpio_mode { MGOS_GPIO_MODE_INPUT, MGOS_GPIO_MODE_OUTPUT };
+enum mgos_gpio_int_mode { MGOS_GPIO_INT_NONE, MGOS_GPIO_INT_EDGE_POS, MGOS_GPIO_INT_EDGE_NEG, MGOS_GPIO_INT_EDGE_ANY };
+typedef void (*mgos_gpio_int_handler_f)(int pin, void *arg);
+bool mgos_gpio_set_mode(int pin, enum mgos_gpio_mode mode);
+bool mgos_gpio_read(int pin);
+bool mgos_gpio_set_int_handler_isr(int pin, enum mgos_gpio_int_mode mode, mgos_gpio_int_handler_f cb, void *arg);
+bool mgos_gpio_enable_int(int pin);
+bool mgos_gpio_disable_int(int pin);
+typedef void (*mgos_cb_t)(void *arg);
+bool mgos_invoke_cb(mgos_cb_t cb, void *arg, bool from_isr);
@@ -0,0 +1,5 @@
+#pragma once
+#include "mgos.h"
+
+bool mgos_adc_enable(int pin);
+int mgos_adc_read(int pin);
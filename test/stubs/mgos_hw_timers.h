@@ -0,0 +1,10 @@
+#pragma once
+#include "mgos.h"
+
+typedef uintptr_t mgos_timer_id;
+typedef void (*timer_callback)(void *arg);
+#define MGOS_INVALID_TIMER_ID 0
+#define MGOS_TIMER_REPEAT 1
+
+mgos_timer_id mgos_set_hw_timer(int usecs, int flags, timer_callback cb, void *cb_arg);
+void mgos_clear_timer(mgos_timer_id id);
@@ -0,0 +1,8 @@
+#pragma once
+#include "mgos.h"
+
+struct mg_connection;
+typedef void (*sub_handler_t)(struct mg_connection *nc, const char *topic, int topic_len,
+                              const char *msg, int msg_len, void *ud);
+bool mgos_mqtt_pubf(const char *topic, int qos, bool retain, const char *fmt, ...);
+void mgos_mqtt_sub(const char *topic, sub_handler_t cb, void *ud);
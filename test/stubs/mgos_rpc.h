@@ -0,0 +1,8 @@
+#pragma once
+#include "mgos.h"
+
+struct mg_rpc_request_info;
+bool mg_rpc_send_responsef(struct mg_rpc_request_info *ri, const char *fmt, ...);
+bool mg_rpc_send_errorf(struct mg_rpc_request_info *ri, int code, const char *fmt, ...);
+typedef void (*mgos_rpc_handler_f)(struct mg_rpc_request_info *ri, const char *args, const char *src, void *user_data);
+bool mgos_rpc_add_handler(const char *method, mgos_rpc_handler_f cb, void *cb_arg);
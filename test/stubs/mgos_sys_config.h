@@ -0,0 +1,25 @@
+/* Config getters of the tested modules, each test defines the ones it links */
+#pragma once
+#include <stdbool.h>
+
+int mgos_sys_config_get_effects_audio_pin(void);
+int mgos_sys_config_get_effects_audio_rate(void);
+bool mgos_sys_config_get_app_clock_enable(void);
+bool mgos_sys_config_get_app_clock_leader(void);
+int mgos_sys_config_get_app_clock_interval(void);
+const char *mgos_sys_config_get_app_clock_topic(void);
+int mgos_sys_config_get_nodes_neopixel_pixels(void);
+int mgos_sys_config_get_strip_speed(void);
+int mgos_sys_config_get_effects_cylon_size(void);
+const char *mgos_sys_config_get_effects_palette_rainbow(void);
+const char *mgos_sys_config_get_effects_palette_heat(void);
+const char *mgos_sys_config_get_effects_palette_strip(void);
+const char *mgos_sys_config_get_effects_palette_file(void);
+bool mgos_sys_config_get_nodes_pir_enable(void);
+int mgos_sys_config_get_nodes_pir_pin(void);
+int mgos_sys_config_get_nodes_pir_sampling_interval(void);
+int mgos_sys_config_get_nodes_pir_sampling_fallback(void);
+bool mgos_sys_config_get_nodes_pir_irq_enable(void);
+int mgos_sys_config_get_nodes_pir_irq_debounce(void);
+const char *mgos_sys_config_get_nodes_pir_stat_topic(void);
+bool mgos_sys_config_get_nodes_pir_inject(void);
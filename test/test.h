@@ -0,0 +1,23 @@
+/*
+ * Minimal checks for the host tests, a failed CHECK prints where and makes
+ * the test exit with 1 once it is done.
+ */
+#pragma once
+#include <stdio.h>
+
+static int s_test_failures = 0;
+
+#define CHECK(cond, ...)                                                  \
+    do {                                                                  \
+        if (!(cond)) {                                                    \
+            s_test_failures++;                                            \
+            printf("%s:%d: CHECK(%s) failed: ", __FILE__, __LINE__, #cond); \
+            printf(__VA_ARGS__);                                          \
+            printf("\n");                                                 \
+        }                                                                 \
+    } while (0)
+
+static int test_result(const char *name) {
+    printf("%s: %s\n", name, s_test_failures == 0 ? "ok" : "FAILED");
+    return s_test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the animation player against tools/make_anim.py. The test
+ * writes raw frames, the Makefile encodes them with the tool and the test
+ * then checks every decoded frame, the loop and seeks to keyframes and to
+ * frames between them. A strip longer than one opcode covers the 64 pixel
+ * limits of RUN, LITERAL and SKIP.
+ */
+
+#include "nvk_anim.h"
+#include "test.h"
+
+#define TEST_PIXELS 150
+#define TEST_FRAMES 25
+
+static uint8_t s_test_strip[TEST_PIXELS][3];
+
+int mgos_sys_config_get_nodes_neopixel_pixels(void) {
+    return TEST_PIXELS;
+}
+
+void node_neopixel_set(int p, int r, int g, int b) {
+    CHECK(p >= 0 && p < TEST_PIXELS, "pixel %d set out of the strip", p);
+    if (p >= 0 && p < TEST_PIXELS) {
+        s_test_strip[p][0] = (uint8_t) r;
+        s_test_strip[p][1] = (uint8_t) g;
+        s_test_strip[p][2] = (uint8_t) b;
+    }
+}
+
+int json_scanf(const char *str, int str_len, const char *fmt, ...) {
+    return 0;
+}
+
+bool mg_rpc_send_responsef(struct mg_rpc_request_info *ri, const char *fmt, ...) {
+    return true;
+}
+
+bool mg_rpc_send_errorf(struct mg_rpc_request_info *ri, int code, const char *fmt, ...) {
+    return true;
+}
+
+/* A static background in runs, a moving dot and a block of noise changing every third frame */
+static void test_pixel(int n, int p, uint8_t *rgb) {
+    uint32_t h = (uint32_t) ((n / 3) * 7919 + p * 104729);
+    h = (h ^ (h >> 7)) * 2654435761u;
+    rgb[0] = rgb[1] = rgb[2] = p < 100 ? 0x10 : 0x00;
+    if (p >= 110 && p < 130) {
+        rgb[0] = (uint8_t) h;
+        rgb[1] = (uint8_t) (h >> 8);
+        rgb[2] = (uint8_t) (h >> 16);
+    }
+    if (p == (n * 5) % TEST_PIXELS) {
+        rgb[0] = 0xFF;
+        rgb[1] = rgb[2] = 0;
+    }
+}
+
+static int test_write_raw(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        printf("cannot write %s\n", path);
+        return 1;
+    }
+    for (int n = 0; n < TEST_FRAMES; n++) {
+        for (int p = 0; p < TEST_PIXELS; p++) {
+            uint8_t rgb[3];
+            test_pixel(n, p, rgb);
+            fwrite(rgb, 1, 3, f);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static bool test_strip_is(int n) {
+    for (int p = 0; p < TEST_PIXELS; p++) {
+        uint8_t rgb[3];
+        test_pixel(n, p, rgb);
+        if (memcmp(rgb, s_test_strip[p], 3) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_play(const char *path) {
+    CHECK(nvk_anim_open(path), "cannot open %s", path);
+    const struct nvk_anim_header *h = nvk_anim_header();
+    if (h == NULL) {
+        return;
+    }
+    CHECK(h->pixels == TEST_PIXELS && h->frames == TEST_FRAMES && h->frame_ms == 40 &&
+          (h->flags & NVK_ANIM_FLAG_LOOP), "header %d pixels %d frames %d ms flags %d",
+          h->pixels, h->frames, h->frame_ms, h->flags);
+    CHECK(h->keyframes == 4, "%d keyframes, 4 expected", h->keyframes);
+    for (int n = 0; n < TEST_FRAMES * 2; n++) {
+        CHECK(nvk_anim_next_frame(), "frame %d not decoded", n);
+        CHECK(test_strip_is(n % TEST_FRAMES), "frame %d differs", n);
+    }
+}
+
+static void test_seek() {
+    const int frames[] = { 0, 8, 13, 24, 3, 16, 7 }; // Keyframes every 8, backwards too
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        memset(s_test_strip, 0xAA, sizeof(s_test_strip));
+        CHECK(nvk_anim_seek(frames[i]), "seek to %d failed", frames[i]);
+        CHECK(nvk_anim_frame() == frames[i], "seek to %d left the player at %d", frames[i], nvk_anim_frame());
+        CHECK(nvk_anim_next_frame() && test_strip_is(frames[i]), "frame %d after seek differs", frames[i]);
+        CHECK(nvk_anim_next_frame() && test_strip_is((frames[i] + 1) % TEST_FRAMES),
+              "frame after a seek to %d differs", frames[i]);
+    }
+    CHECK(!nvk_anim_seek(-1) && !nvk_anim_seek(TEST_FRAMES), "seek out of the animation accepted");
+    nvk_anim_close();
+    CHECK(nvk_anim_header() == NULL && !nvk_anim_next_frame(), "closed animation still plays");
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 && strcmp(argv[1], "raw") == 0) {
+        return test_write_raw(argv[2]);
+    }
+    test_play(argc > 1 ? argv[1] : "anim.bin");
+    test_seek();
+    return test_result("anim");
+}
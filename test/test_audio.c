@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the audio analysis. Test tones are written as 8 kHz mono
+ * WAV files and played back through audio_set_source(), checking the
+ * band each tone lands in, the level, beats and the ADC ring buffer. The
+ * hardware timer is driven on a fake clock to check the block cadence.
+ * test_audio <dir> writes the WAV files in dir, test_audio <file.wav>
+ * prints the frames of any 16 bit mono recording instead.
+ */
+
+#include <math.h>
+#include "mgos.h"
+#include "mgos_adc.h"
+#include "mgos_hw_timers.h"
+#include "nvk_audio.h"
+#include "test.h"
+
+#define TEST_RATE 8000
+#define TEST_FRAMES 16 // Blocks of NVK_AUDIO_FRAME samples per tone
+#define AUDIO_EFFECT_FRAME_US 20000 // AUDIO_EFFECT_FRAME_MS of the audio effects
+
+/* FFT bin at the middle of each band, a whole number of periods per block */
+static const int TEST_BAND_BINS[NVK_AUDIO_BANDS] = { 1, 2, 3, 4, 7, 10, 16, 25 };
+
+static int s_test_rate = TEST_RATE;
+static timer_callback s_test_isr = NULL;
+static int s_test_adc = 512;
+static int s_test_isr_us = 0;
+static int64_t s_test_now_us = 0;
+static int s_test_uptime_step = 0; // Added on every read, time spent between two reads
+
+int mgos_sys_config_get_effects_audio_pin(void) {
+    return 0;
+}
+
+int mgos_sys_config_get_effects_audio_rate(void) {
+    return s_test_rate;
+}
+
+int64_t mgos_uptime_micros(void) {
+    s_test_now_us += s_test_uptime_step;
+    return s_test_now_us;
+}
+
+bool mgos_adc_enable(int pin) {
+    return pin == 0;
+}
+
+int mgos_adc_read(int pin) {
+    return s_test_adc;
+}
+
+mgos_timer_id mgos_set_hw_timer(int usecs, int flags, timer_callback cb, void *cb_arg) {
+    CHECK(usecs == 1000000 / TEST_RATE, "hw timer period %d us", usecs);
+    s_test_isr = cb;
+    s_test_isr_us = usecs;
+    return 1;
+}
+
+void mgos_clear_timer(mgos_timer_id id) {
+    s_test_isr = NULL;
+}
+
+static void test_put_u32(FILE *f, uint32_t v) {
+    uint8_t b[4] = { v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, (v >> 24) & 0xFF };
+    fwrite(b, 1, 4, f);
+}
+
+static void test_put_u16(FILE *f, uint16_t v) {
+    uint8_t b[2] = { v & 0xFF, (v >> 8) & 0xFF };
+    fwrite(b, 1, 2, f);
+}
+
+/* Sine at bin of the block with amplitude amp (Q15) for blocks blocks */
+static void test_write_wav(const char *path, int bin, int amp, int blocks) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        CHECK(f != NULL, "cannot write %s", path);
+        return;
+    }
+    uint32_t samples = (uint32_t) blocks * NVK_AUDIO_FRAME;
+    fwrite("RIFF", 1, 4, f);
+    test_put_u32(f, 36 + samples * 2);
+    fwrite("WAVEfmt ", 1, 8, f);
+    test_put_u32(f, 16);
+    test_put_u16(f, 1); // PCM
+    test_put_u16(f, 1); // mono
+    test_put_u32(f, TEST_RATE);
+    test_put_u32(f, TEST_RATE * 2);
+    test_put_u16(f, 2);
+    test_put_u16(f, 16);
+    fwrite("data", 1, 4, f);
+    test_put_u32(f, samples * 2);
+    for (uint32_t i = 0; i < samples; i++) {
+        double v = amp * sin(2 * M_PI * bin * (double) i / NVK_AUDIO_FRAME);
+        test_put_u16(f, (uint16_t) (int16_t) lrint(v));
+    }
+    fclose(f);
+}
+
+/* Reads from the data chunk of a 16 bit mono WAV file */
+static int test_wav_read(int16_t *buf, int n, void *ctx) {
+    FILE *f = (FILE *) ctx;
+    int read = 0;
+    uint8_t b[2];
+    while (read < n && fread(b, 1, 2, f) == 2) {
+        buf[read++] = (int16_t) (b[0] | (b[1] << 8));
+    }
+    return read;
+}
+
+static FILE *test_wav_open(const char *path) {
+    FILE *f = fopen(path, "rb");
+    char id[4];
+    uint8_t size[4];
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 12, SEEK_SET);
+    while (fread(id, 1, 4, f) == 4 && fread(size, 1, 4, f) == 4) {
+        long len = size[0] | (size[1] << 8) | (size[2] << 16) | ((long) size[3] << 24);
+        if (memcmp(id, "data", 4) == 0) {
+            return f;
+        }
+        fseek(f, len, SEEK_CUR);
+    }
+    fclose(f);
+    return NULL;
+}
+
+/* Plays a tone, frames are left with the last block */
+static int test_play(const char *dir, const char *name, int bin, int amp, int blocks,
+                     struct audio_frame *frames) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.wav", dir, name);
+    test_write_wav(path, bin, amp, blocks);
+    FILE *f = test_wav_open(path);
+    CHECK(f != NULL, "cannot read %s", path);
+    if (f == NULL) {
+        return 0;
+    }
+    struct audio_source source = { test_wav_read, f };
+    audio_set_source(&source);
+    int n = 0;
+    while (n < blocks && audio_process(&frames[n])) {
+        n++;
+    }
+    audio_set_source(NULL);
+    fclose(f);
+    return n;
+}
+
+static int test_loudest_band(const struct audio_frame *frame) {
+    int loudest = 0;
+    for (int b = 1; b < NVK_AUDIO_BANDS; b++) {
+        if (frame->bands[b] > frame->bands[loudest]) {
+            loudest = b;
+        }
+    }
+    return loudest;
+}
+
+static void test_bands(const char *dir) {
+    struct audio_frame frames[TEST_FRAMES];
+    for (int b = 0; b < NVK_AUDIO_BANDS; b++) {
+        char name[16];
+        snprintf(name, sizeof(name), "band%d", b);
+        int n = test_play(dir, name, TEST_BAND_BINS[b], 12000, TEST_FRAMES, frames);
+        CHECK(n == TEST_FRAMES, "%s gave %d blocks", name, n);
+        for (int i = 1; i < n; i++) {
+            CHECK(test_loudest_band(&frames[i]) == b, "%s block %d is loudest in band %d", name, i,
+                  test_loudest_band(&frames[i]));
+            CHECK(frames[i].bands[b] >= 200, "%s block %d band energy %d", name, i, frames[i].bands[b]);
+        }
+    }
+}
+
+static void test_level(const char *dir) {
+    struct audio_frame frames[TEST_FRAMES];
+    test_play(dir, "silence", 0, 0, TEST_FRAMES, frames);
+    CHECK(frames[TEST_FRAMES - 1].level == 0, "silence level %d", frames[TEST_FRAMES - 1].level);
+    CHECK(!frames[TEST_FRAMES - 1].beat, "beat in silence");
+
+    // The mean of |sin| is 2 / pi of the amplitude
+    int amps[] = { 4096, 8192, 16384 };
+    for (int i = 0; i < 3; i++) {
+        test_play(dir, "level", 4, amps[i], TEST_FRAMES, frames);
+        int expected = (int) (amps[i] * 2 / M_PI * 255 / 16384);
+        int level = frames[TEST_FRAMES - 1].level;
+        CHECK(abs(level - expected) <= 3, "amplitude %d level %d, expected %d", amps[i], level, expected);
+    }
+}
+
+static void test_beat(const char *dir) {
+    struct audio_frame frames[64];
+    test_play(dir, "steady", 1, 2000, 64, frames);
+    for (int i = 48; i < 64; i++) {
+        CHECK(!frames[i].beat, "beat in steady block %d", i);
+    }
+    test_play(dir, "kick", 1, 16000, 1, frames);
+    CHECK(frames[0].beat, "no beat on a 8x louder low block");
+}
+
+static void test_adc_ring() {
+    struct audio_frame frame;
+    s_test_rate = 0;
+    CHECK(!audio_start(), "rate 0 accepted");
+    s_test_rate = TEST_RATE;
+    CHECK(audio_start(), "audio_start failed");
+    CHECK(s_test_isr != NULL, "no hw timer");
+    if (s_test_isr == NULL) {
+        return;
+    }
+    for (int i = 0; i < NVK_AUDIO_FRAME - 1; i++) {
+        s_test_isr(NULL);
+    }
+    CHECK(!audio_process(&frame), "a block from %d samples", NVK_AUDIO_FRAME - 1);
+    // Full scale square wave at bin 4 for the whole ring
+    for (int i = 0; i < NVK_AUDIO_FRAME * 2; i++) {
+        s_test_adc = (i / 8) % 2 ? 1023 : 0;
+        s_test_isr(NULL);
+    }
+    CHECK(audio_process(&frame), "no block from the ring");
+    CHECK(test_loudest_band(&frame) == 3, "ring block loudest in band %d", test_loudest_band(&frame));
+    CHECK(!audio_process(&frame), "the same block twice");
+    audio_stop();
+    CHECK(s_test_isr == NULL, "hw timer left running");
+}
+
+/* Runs the sampling timer on the fake clock, polling audio_process every poll_us for 1 s */
+static int test_cadence(int poll_us, int64_t *first, int64_t *gap_min, int64_t *gap_max) {
+    struct audio_frame frame;
+    int blocks = 0;
+    int64_t last = -1;
+    int64_t next_isr = s_test_now_us + s_test_isr_us;
+    int64_t end = s_test_now_us + 1000000;
+    *gap_min = INT64_MAX;
+    *gap_max = 0;
+    for (int64_t poll = s_test_now_us + poll_us; poll <= end; poll += poll_us) {
+        for (; next_isr <= poll; next_isr += s_test_isr_us) {
+            s_test_now_us = next_isr;
+            s_test_isr(NULL);
+        }
+        s_test_now_us = poll;
+        if (!audio_process(&frame)) {
+            continue;
+        }
+        if (last < 0) {
+            *first = poll;
+        } else {
+            *gap_min = poll - last < *gap_min ? poll - last : *gap_min;
+            *gap_max = poll - last > *gap_max ? poll - last : *gap_max;
+        }
+        last = poll;
+        blocks++;
+        CHECK(frame.time_us == (uint32_t) s_test_uptime_step, "block took %u us on a clock moving %d us a read",
+              frame.time_us, s_test_uptime_step);
+    }
+    return blocks;
+}
+
+static void test_timing() {
+    CHECK(audio_start() && s_test_isr != NULL, "audio_start failed");
+    if (s_test_isr == NULL) {
+        return;
+    }
+    int64_t block_us = (int64_t) NVK_AUDIO_FRAME * s_test_isr_us;
+    int64_t start = s_test_now_us;
+    int64_t first, gap_min, gap_max;
+    s_test_uptime_step = 40;
+
+    // Polled faster than the blocks fill, one block every NVK_AUDIO_FRAME samples
+    int blocks = test_cadence(1000, &first, &gap_min, &gap_max);
+    CHECK(blocks == 1000000 / block_us, "%d blocks in 1 s, %lld expected", blocks, (long long) (1000000 / block_us));
+    CHECK(first - start == block_us, "first block after %lld us, %lld expected", (long long) (first - start),
+          (long long) block_us);
+    CHECK(gap_min == block_us && gap_max == block_us, "blocks %lld - %lld us apart, %lld expected",
+          (long long) gap_min, (long long) gap_max, (long long) block_us);
+
+    // At the effect frame rate every frame gets the newest block
+    blocks = test_cadence(AUDIO_EFFECT_FRAME_US, &first, &gap_min, &gap_max);
+    CHECK(blocks == 1000000 / AUDIO_EFFECT_FRAME_US, "%d blocks in 1 s at one poll per effect frame", blocks);
+    CHECK(gap_min == AUDIO_EFFECT_FRAME_US && gap_max == AUDIO_EFFECT_FRAME_US, "effect frames %lld - %lld us apart",
+          (long long) gap_min, (long long) gap_max);
+    s_test_uptime_step = 0;
+    audio_stop();
+}
+
+/* Frames of a recording, for tuning against real music */
+static int test_print_wav(const char *path) {
+    FILE *f = test_wav_open(path);
+    if (f == NULL) {
+        printf("%s: not a WAV file\n", path);
+        return 1;
+    }
+    struct audio_source source = { test_wav_read, f };
+    struct audio_frame frame;
+    audio_set_source(&source);
+    for (int n = 0; audio_process(&frame); n++) {
+        printf("%5d level %3d beat %d bands", n, frame.level, frame.beat);
+        for (int b = 0; b < NVK_AUDIO_BANDS; b++) {
+            printf(" %3d", frame.bands[b]);
+        }
+        printf("\n");
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : ".";
+    size_t len = strlen(dir);
+    if (len > 4 && strcmp(dir + len - 4, ".wav") == 0) {
+        return test_print_wav(dir);
+    }
+    test_bands(dir);
+    test_level(dir);
+    test_beat(dir);
+    test_adc_ring();
+    test_timing();
+    return test_result("audio");
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the fleet clock filter. A simulated leader runs with an
+ * offset and a drift, its samples arrive with random latency, and the
+ * follower's shared time is compared with the leader's true time. Two
+ * followers fed the same messages with their own latency are compared
+ * with each other through nvk_clock_frame.
+ */
+
+#include "../src/nvk_clock.c"
+#include "test.h"
+
+#define TEST_INTERVAL_MS 2000
+#define TEST_OFFSET_US 5000000LL
+#define TEST_DRIFT_PPB 100000 // Leader 100 ppm fast
+#define TEST_LATENCY_US 30000 // Uniform 0 - 30 ms
+
+static int64_t s_test_now_us = 0;
+static uint32_t s_test_seed = 1;
+
+int64_t mgos_uptime_micros(void) {
+    return s_test_now_us;
+}
+
+bool mgos_sys_config_get_app_clock_enable(void) {
+    return true;
+}
+
+bool mgos_sys_config_get_app_clock_leader(void) {
+    return false;
+}
+
+int mgos_sys_config_get_app_clock_interval(void) {
+    return TEST_INTERVAL_MS;
+}
+
+const char *mgos_sys_config_get_app_clock_topic(void) {
+    return "clock";
+}
+
+bool mgos_mqtt_pubf(const char *topic, int qos, bool retain, const char *fmt, ...) {
+    return true;
+}
+
+void mgos_mqtt_sub(const char *topic, sub_handler_t cb, void *ud) {
+}
+
+nvk_sched_id nvk_sched_set(int msecs, bool repeat, enum nvk_sched_group group, nvk_sched_cb_t cb, void *arg) {
+    return 1;
+}
+
+int json_scanf(const char *str, int str_len, const char *fmt, ...) {
+    return 0;
+}
+
+bool mg_rpc_send_responsef(struct mg_rpc_request_info *ri, const char *fmt, ...) {
+    return true;
+}
+
+/* Same LCG on every host so the runs are repeatable */
+static int64_t test_latency_us() {
+    s_test_seed = s_test_seed * 1103515245 + 12345;
+    return (s_test_seed >> 8) % TEST_LATENCY_US;
+}
+
+static int64_t test_leader_us(int64_t local, int64_t offset) {
+    return local + local / 1000 * TEST_DRIFT_PPB / 1000000 + offset;
+}
+
+/* Error of the shared time against the leader in us */
+static int64_t test_error_us(int64_t offset) {
+    return nvk_clock_now_ms() * 1000 - test_leader_us(s_test_now_us, offset);
+}
+
+/* One leader message sent at the start of interval k, received after the latency */
+static void test_step(int k, int64_t offset) {
+    int64_t sent = (int64_t) k * TEST_INTERVAL_MS * 1000 + 12345;
+    s_test_now_us = sent + test_latency_us();
+    nvk_clock_sample(test_leader_us(sent, offset), s_test_now_us);
+}
+
+static void test_drift_and_jitter() {
+    int k = 0;
+    for (; k < 300; k++) {
+        test_step(k, TEST_OFFSET_US);
+    }
+    CHECK(nvk_clock_synced(), "not synced");
+    int64_t worst = 0;
+    int64_t drift = 0;
+    for (; k < 400; k++) {
+        test_step(k, TEST_OFFSET_US);
+        int64_t error = test_error_us(TEST_OFFSET_US);
+        worst = llabs(error) > worst ? llabs(error) : worst;
+        drift += s_nvk_clock.drift;
+    }
+    // Each sample moves the drift by the jitter over 2 s, only its mean follows the leader
+    drift /= 100;
+    CHECK(llabs(drift - TEST_DRIFT_PPB) < 50000, "mean drift %lld ppb, leader %d ppb", (long long) drift,
+          TEST_DRIFT_PPB);
+    // The latency is one-way, so the mean of it is a bias on top of the jitter
+    CHECK(worst < TEST_LATENCY_US, "worst error %lld us with up to %d us latency", (long long) worst,
+          TEST_LATENCY_US);
+    CHECK(s_nvk_clock.total_outliers == 0, "%d outliers from jitter", s_nvk_clock.total_outliers);
+
+    // Without samples the follower falls back to its own clock
+    s_test_now_us += (int64_t) TEST_INTERVAL_MS * 1000 * (NVK_CLOCK_STALE_PERIODS + 1);
+    CHECK(!nvk_clock_synced(), "still synced without samples");
+}
+
+static void test_outliers() {
+    int k = 400;
+    for (; k < 450; k++) {
+        test_step(k, TEST_OFFSET_US);
+    }
+    int64_t offset = s_nvk_clock.offset;
+    int outliers = s_nvk_clock.total_outliers;
+
+    // A single late message is dropped without moving the filter
+    test_step(k++, TEST_OFFSET_US - 2 * NVK_CLOCK_MAX_ERROR);
+    CHECK(s_nvk_clock.total_outliers == outliers + 1, "outlier not counted");
+    CHECK(llabs(s_nvk_clock.offset - offset) < 1000, "offset moved by %lld us on an outlier",
+          (long long) (s_nvk_clock.offset - offset));
+    test_step(k++, TEST_OFFSET_US);
+    CHECK(s_nvk_clock.outliers == 0, "outlier run not ended by a good sample");
+
+    // A restarted leader is taken as it is after NVK_CLOCK_MAX_OUTLIERS samples in a row
+    int64_t restarted = -TEST_OFFSET_US;
+    for (int i = 0; i < NVK_CLOCK_MAX_OUTLIERS; i++) {
+        test_step(k++, restarted);
+    }
+    CHECK(s_nvk_clock.drift == 0, "drift %d kept across a reset", s_nvk_clock.drift);
+    CHECK(llabs(test_error_us(restarted)) < TEST_LATENCY_US, "error %lld us after a reset",
+          (long long) test_error_us(restarted));
+    for (int i = 0; i < 300; i++) {
+        test_step(k++, restarted);
+    }
+    CHECK(llabs(test_error_us(restarted)) < TEST_LATENCY_US, "error %lld us after settling again",
+          (long long) test_error_us(restarted));
+}
+
+/* Follower state swapped in and out of the single filter */
+static void test_follower_step(struct nvk_clock *follower, int k, int64_t local_offset) {
+    int64_t sent = (int64_t) k * TEST_INTERVAL_MS * 1000 + 12345;
+    s_nvk_clock = *follower;
+    s_test_now_us = sent + test_latency_us() + local_offset;
+    nvk_clock_sample(test_leader_us(sent, TEST_OFFSET_US), s_test_now_us);
+    *follower = s_nvk_clock;
+}
+
+/* Frame of the follower at the leader's true time, and the follower's error */
+static int32_t test_follower_frame(struct nvk_clock *follower, int64_t true_us, int64_t local_offset,
+                                   int period, int64_t *error) {
+    int32_t counter = 0;
+    s_nvk_clock = *follower;
+    s_test_now_us = true_us + local_offset;
+    int32_t frame = nvk_clock_frame(&counter, period);
+    *error = nvk_clock_now_ms() * 1000 - test_leader_us(true_us, TEST_OFFSET_US);
+    return frame;
+}
+
+static void test_two_followers() {
+    const int64_t local_offset[2] = { 0, 7654321 }; // Booted at different times
+    const int period = 20;
+    struct nvk_clock followers[2] = { { 0 }, { 0 } };
+    int k = 0;
+    for (; k < 300; k++) {
+        test_follower_step(&followers[0], k, local_offset[0]);
+        test_follower_step(&followers[1], k, local_offset[1]);
+    }
+    int same = 0;
+    int checks = 0;
+    int64_t worst = 0;
+    int64_t bias = 0;
+    for (; k < 400; k++) {
+        test_follower_step(&followers[0], k, local_offset[0]);
+        test_follower_step(&followers[1], k, local_offset[1]);
+        for (int t = 0; t < 10; t++, checks++) {
+            int64_t true_us = (int64_t) k * TEST_INTERVAL_MS * 1000 + 100000 + t * 137000;
+            int64_t e0, e1;
+            int32_t f0 = test_follower_frame(&followers[0], true_us, local_offset[0], period, &e0);
+            int32_t f1 = test_follower_frame(&followers[1], true_us, local_offset[1], period, &e1);
+            same += f0 == f1;
+            CHECK(abs(f0 - f1) <= 1, "followers %d frames apart", abs(f0 - f1));
+            worst = llabs(e0 - e1) > worst ? llabs(e0 - e1) : worst;
+            bias += e0 + e1;
+        }
+    }
+    bias /= checks * 2;
+    // Both lag the leader by about the mean latency, that part is common to them
+    CHECK(bias < 0 && -bias < TEST_LATENCY_US, "bias %lld us with up to %d us latency", (long long) bias,
+          TEST_LATENCY_US);
+    CHECK(worst < TEST_LATENCY_US * 2 / 3, "followers %lld us apart", (long long) worst);
+    CHECK(same * 10 >= checks * 6, "followers on the same frame %d of %d times", same, checks);
+}
+
+int main() {
+    test_drift_and_jitter();
+    test_outliers();
+    test_two_followers();
+    return test_result("clock");
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the fixed point helpers against the exact maths they
+ * replace, over every input for the 8 bit ones.
+ */
+
+#include <math.h>
+#include "mgos.h"
+#include "nvk_fixed.h"
+#include "test.h"
+
+static void test_div255() {
+    for (uint32_t x = 0; x < 65535; x++) {
+        if (fixed_div255(x) != x / 255) {
+            CHECK(fixed_div255(x) == x / 255, "div255(%u) = %u", x, fixed_div255(x));
+            return;
+        }
+    }
+}
+
+static void test_scale8() {
+    for (int v = 0; v < 256; v++) {
+        CHECK(fixed_scale8(v, 255) == v, "scale8(%d, 255) = %d", v, fixed_scale8(v, 255));
+        CHECK(fixed_scale8(v, 0) == 0 || v == 255, "scale8(%d, 0) = %d", v, fixed_scale8(v, 0));
+        for (int s = 0; s < 256; s++) {
+            int exact = v * (s + 1) / 256;
+            if (fixed_scale8(v, s) != exact) {
+                CHECK(fixed_scale8(v, s) == exact, "scale8(%d, %d) = %d", v, s, fixed_scale8(v, s));
+                return;
+            }
+        }
+    }
+}
+
+static void test_qadd8() {
+    CHECK(fixed_qadd8(200, 100) == 255, "qadd8(200, 100) = %d", fixed_qadd8(200, 100));
+    CHECK(fixed_qadd8(100, 100) == 200, "qadd8(100, 100) = %d", fixed_qadd8(100, 100));
+}
+
+static void test_lerp8() {
+    int wrong = 0;
+    for (int a = 0; a < 256; a++) {
+        for (int b = 0; b < 256; b++) {
+            wrong += fixed_lerp8(a, b, 0) != a || fixed_lerp8(a, b, 255) != b;
+            for (int t = 1; t < 255; t++) {
+                double exact = a + (b - a) * t / 255.0;
+                wrong += fabs(fixed_lerp8(a, b, t) - exact) > 0.5;
+            }
+        }
+    }
+    CHECK(wrong == 0, "%d lerp8 results not rounded to the nearest", wrong);
+}
+
+static void test_sin8() {
+    for (int i = 0; i < 256; i++) {
+        double exact = 128 + 127 * sin(2 * M_PI * i / 256);
+        CHECK(fabs(fixed_sin8(i) - exact) <= 1.0, "sin8(%d) = %d, exact %.2f", i, fixed_sin8(i), exact);
+    }
+}
+
+static void test_q16() {
+    // The per pixel steps of the rainbow cycle, VU and spectrum effects
+    int scales[] = { 256, 255, 8 };
+    for (int s = 0; s < 3; s++) {
+        for (int n = 1; n < 256; n++) {
+            q16_16 step = fixed_q16_ratio(scales[s], n);
+            for (int p = 0; p < n; p++) {
+                if (fixed_q16_int(p * step) != p * scales[s] / n) {
+                    CHECK(fixed_q16_int(p * step) == p * scales[s] / n, "pixel %d of %d x %d gives %d", p, n,
+                          scales[s], fixed_q16_int(p * step));
+                    return;
+                }
+            }
+        }
+    }
+    CHECK(fixed_q16_ratio(1, 0) == 0, "ratio by 0");
+    CHECK(fixed_q16_mul(FIXED_Q16(3), FIXED_Q16(1) / 2) == FIXED_Q16(3) / 2, "3 * 0.5");
+}
+
+int main() {
+    test_div255();
+    test_scale8();
+    test_qadd8();
+    test_lerp8();
+    test_sin8();
+    test_q16();
+    return test_result("fixed");
+}
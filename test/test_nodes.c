@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the range watcher shared by the DHT and photoresistor nodes:
+ * events only on a change of state, held for the dwell, at most one per
+ * interval and with the hysteresis on the way back inside a bound.
+ */
+
+#include "mgos.h"
+#include "mgos_time.h"
+#include "nvk_nodes.h"
+#include "test.h"
+
+#define TEST_MIN 100
+#define TEST_MAX 200
+#define TEST_HYSTERESIS 10
+#define TEST_DWELL_MS 250
+#define TEST_INTERVAL_MS 2000
+#define TEST_STEP_MS 125 // Exact in binary, the uptime is a double
+
+static double s_test_now = 128.0;
+static int s_test_on = 0;
+static int s_test_above = 0;
+static int s_test_below = 0;
+
+double mgos_uptime(void) {
+    return s_test_now;
+}
+
+bool node_dht_init() {
+    return true;
+}
+
+bool node_pir_init() {
+    return true;
+}
+
+bool node_photoresistor_init() {
+    return true;
+}
+
+bool node_neopixel_init() {
+    return true;
+}
+
+static void test_on_range(struct node_range_values *values, void *user_data) {
+    s_test_on++;
+}
+
+static void test_out_range(enum node_out_range_event_type ev, struct node_range_values *values, void *user_data) {
+    if (ev == ABOVE_OF_RANGE) {
+        s_test_above++;
+    } else {
+        s_test_below++;
+    }
+}
+
+/* Feeds value every TEST_STEP_MS for ms, returns the number of events fired */
+static int test_feed(struct node_range_threshold *t, int value, int ms) {
+    int fired = 0;
+    for (int elapsed = 0; elapsed <= ms; elapsed += TEST_STEP_MS) {
+        fired += node_range_threshold_update(t, value, TEST_MIN, TEST_MAX);
+        s_test_now += TEST_STEP_MS / 1000.0;
+    }
+    return fired;
+}
+
+int main() {
+    struct node_range_threshold t = { .on_range = test_on_range, .out_range = test_out_range };
+    node_range_threshold_init(&t, TEST_HYSTERESIS, TEST_DWELL_MS, TEST_INTERVAL_MS, NULL);
+
+    // The first state is reported once it held for the dwell, with no interval
+    CHECK(test_feed(&t, 150, TEST_DWELL_MS - TEST_STEP_MS) == 0, "on range before the dwell");
+    CHECK(test_feed(&t, 150, 0) == 1 && s_test_on == 1, "first state not reported after the dwell");
+    CHECK(test_feed(&t, 160, 3000) == 0, "on range reported again without a change");
+
+    // Spikes shorter than the dwell are ignored
+    test_feed(&t, 250, TEST_STEP_MS);
+    CHECK(test_feed(&t, 150, 500) == 0 && s_test_above == 0, "spike above the range reported");
+
+    CHECK(test_feed(&t, 250, TEST_DWELL_MS) == 1 && s_test_above == 1, "above not reported after the dwell");
+    // Back inside by less than the hysteresis is still above
+    CHECK(test_feed(&t, TEST_MAX - TEST_HYSTERESIS + 1, 3000) == 0, "on range inside the hysteresis");
+    CHECK(t.state == ABOVE_OF_RANGE, "state %d inside the hysteresis", t.state);
+    CHECK(test_feed(&t, TEST_MAX - TEST_HYSTERESIS, TEST_DWELL_MS) == 1 && s_test_on == 2,
+          "not on range past the hysteresis");
+
+    // A new state right after an event waits for the interval
+    int fired = test_feed(&t, 50, TEST_DWELL_MS);
+    CHECK(fired == 0, "below reported %d times within the interval", fired);
+    fired = test_feed(&t, 50, TEST_INTERVAL_MS);
+    CHECK(fired == 1 && s_test_below == 1, "below reported %d times after the interval", fired);
+    CHECK(test_feed(&t, TEST_MIN + TEST_HYSTERESIS - 1, 3000) == 0 && t.state == BELOW_OF_RANGE,
+          "on range inside the hysteresis of min");
+    CHECK(test_feed(&t, TEST_MIN + TEST_HYSTERESIS, TEST_DWELL_MS) == 1 && s_test_on == 3,
+          "not on range past the hysteresis of min");
+    return test_result("nodes");
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2018 Novutek S.C.
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the PIR edge path. GPIO interrupts and Nodes.PIR.Inject run
+ * on a fake clock and scheduler, checking the debounce, the settle read of
+ * the pin and that no edge is ever stamped after the current time.
+ */
+
+#include <stdarg.h>
+#include "../src/nvk_nodes_pir.c"
+#include "test.h"
+
+#define TEST_DEBOUNCE_MS 50
+#define TEST_TIMERS 8
+
+struct test_timer {
+    bool used;
+    int64_t due;
+    int msecs;
+    bool repeat;
+    nvk_sched_cb_t cb;
+    void *arg;
+};
+
+static int64_t s_test_now_us = 1000000;
+static struct test_timer s_test_timers[TEST_TIMERS];
+static bool s_test_pin = false;
+static mgos_gpio_int_handler_f s_test_isr = NULL;
+static int s_test_toggles = 0;
+static int s_test_responses = 0;
+static int s_test_errors = 0;
+static char s_test_response[128];
+
+int8_t g_nvk_log_levels[NVK_LOG_MODULES];
+
+void nvk_log_write(enum nvk_log_module module, int level, enum nvk_log_msg msg, int32_t a0, int32_t a1, int32_t a2) {
+}
+
+int64_t mgos_uptime_micros(void) {
+    return s_test_now_us;
+}
+
+bool mgos_sys_config_get_nodes_pir_enable(void) {
+    return true;
+}
+
+int mgos_sys_config_get_nodes_pir_pin(void) {
+    return 14;
+}
+
+int mgos_sys_config_get_nodes_pir_sampling_interval(void) {
+    return 500;
+}
+
+int mgos_sys_config_get_nodes_pir_sampling_fallback(void) {
+    return 5000;
+}
+
+bool mgos_sys_config_get_nodes_pir_irq_enable(void) {
+    return true;
+}
+
+int mgos_sys_config_get_nodes_pir_irq_debounce(void) {
+    return TEST_DEBOUNCE_MS;
+}
+
+const char *mgos_sys_config_get_nodes_pir_stat_topic(void) {
+    return "pir";
+}
+
+bool mgos_sys_config_get_nodes_pir_inject(void) {
+    return true;
+}
+
+bool mgos_gpio_set_mode(int pin, enum mgos_gpio_mode mode) {
+    return true;
+}
+
+bool mgos_gpio_read(int pin) {
+    return s_test_pin;
+}
+
+bool mgos_gpio_set_int_handler_isr(int pin, enum mgos_gpio_int_mode mode, mgos_gpio_int_handler_f cb, void *arg) {
+    s_test_isr = cb;
+    return true;
+}
+
+bool mgos_gpio_enable_int(int pin) {
+    return true;
+}
+
+bool mgos_gpio_disable_int(int pin) {
+    return true;
+}
+
+bool mgos_invoke_cb(mgos_cb_t cb, void *arg, bool from_isr) {
+    cb(arg);
+    return true;
+}
+
+bool mgos_mqtt_pubf(const char *topic, int qos, bool retain, const char *fmt, ...) {
+    return true;
+}
+
+bool mgos_rpc_add_handler(const char *method, mgos_rpc_handler_f cb, void *cb_arg) {
+    return true;
+}
+
+/* Only the Nodes.PIR.Inject arguments */
+int json_scanf(const char *str, int str_len, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char **edges = va_arg(ap, char **);
+    int *gap = va_arg(ap, int *);
+    va_end(ap);
+    char buf[64];
+    int n = sscanf(str, "{edges: \"%63[^\"]\", gap: %d}", buf, gap);
+    if (n >= 1) {
+        *edges = strdup(buf);
+    }
+    return n;
+}
+
+bool mg_rpc_send_responsef(struct mg_rpc_request_info *ri, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(s_test_response, sizeof(s_test_response), fmt, ap);
+    va_end(ap);
+    s_test_responses++;
+    return true;
+}
+
+bool mg_rpc_send_errorf(struct mg_rpc_request_info *ri, int code, const char *fmt, ...) {
+    s_test_errors++;
+    return true;
+}
+
+nvk_sched_id nvk_sched_set(int msecs, bool repeat, enum nvk_sched_group group, nvk_sched_cb_t cb, void *arg) {
+    for (int t = 0; t < TEST_TIMERS; t++) {
+        if (!s_test_timers[t].used) {
+            struct test_timer timer = { true, s_test_now_us + (int64_t) msecs * 1000, msecs, repeat, cb, arg };
+            s_test_timers[t] = timer;
+            return t + 1;
+        }
+    }
+    CHECK(false, "out of test timers");
+    return NVK_SCHED_INVALID_ID;
+}
+
+static void test_pir_toggle(int value, void *user_data) {
+    s_test_toggles++;
+    CHECK(s_node_pir_last_edge_time <= s_test_now_us, "edge stamped %lld us ahead",
+          (long long) (s_node_pir_last_edge_time - s_test_now_us));
+}
+
+/* Runs the timers due up to ms from now in order, the clock follows them */
+static void test_run(int ms) {
+    int64_t until = s_test_now_us + (int64_t) ms * 1000;
+    while (true) {
+        struct test_timer *next = NULL;
+        for (int t = 0; t < TEST_TIMERS; t++) {
+            struct test_timer *timer = &s_test_timers[t];
+            if (timer->used && timer->due <= until && (next == NULL || timer->due < next->due)) {
+                next = timer;
+            }
+        }
+        if (next == NULL) {
+            break;
+        }
+        s_test_now_us = next->due;
+        nvk_sched_cb_t cb = next->cb;
+        void *arg = next->arg;
+        if (next->repeat) {
+            next->due += (int64_t) next->msecs * 1000;
+        } else {
+            next->used = false;
+        }
+        cb(arg);
+        CHECK(s_node_pir_last_edge_time <= s_test_now_us, "last edge %lld us ahead of the clock",
+              (long long) (s_node_pir_last_edge_time - s_test_now_us));
+    }
+    s_test_now_us = until;
+}
+
+static void test_edge(bool level) {
+    s_test_pin = level;
+    s_test_isr(14, NULL);
+}
+
+static void test_isr_debounce() {
+    CHECK(node_pir_init() && s_test_isr != NULL, "PIR not initialised with interrupts");
+    if (s_test_isr == NULL) {
+        return;
+    }
+    node_pir_set_pir_toggle_handler(test_pir_toggle);
+
+    test_edge(true);
+    CHECK(node_pir_get_state() == 1 && s_test_toggles == 1, "rising edge not delivered at once");
+    CHECK(node_pir_get_last_edge_time() == s_test_now_us, "edge not stamped with the interrupt time");
+
+    // Bounces inside the window are dropped, the pin is read again when it closes
+    test_run(10);
+    test_edge(false);
+    test_run(5);
+    test_edge(true);
+    CHECK(node_pir_get_state() == 1 && s_test_toggles == 1, "bounce delivered");
+    CHECK(s_node_pir_rejected_edges == 1, "%d edges rejected, 1 expected", s_node_pir_rejected_edges);
+    test_run(TEST_DEBOUNCE_MS);
+    CHECK(node_pir_get_state() == 1 && s_test_toggles == 1, "settle changed a stable pin");
+
+    // A bounce that ends low is taken when the window closes
+    test_run(100);
+    test_edge(false);
+    test_run(10);
+    test_edge(true);
+    test_run(5);
+    s_test_pin = false; // Settled low without another interrupt
+    test_run(TEST_DEBOUNCE_MS);
+    CHECK(node_pir_get_state() == 0 && s_test_toggles == 2, "state %d after a bounce ending low, %d toggles",
+          node_pir_get_state(), s_test_toggles);
+    test_run(1000);
+}
+
+static void test_inject() {
+    int toggles = s_test_toggles;
+    int64_t start = s_test_now_us;
+    s_test_pin = false;
+    node_pir_rpc_inject_handler(NULL, "{edges: \"1010\", gap: 20}", NULL, NULL);
+    CHECK(s_test_responses == 0, "answered before the edges were replayed");
+    CHECK(node_pir_get_state() == 1 && node_pir_get_last_edge_time() == start, "first edge not injected now");
+    node_pir_rpc_inject_handler(NULL, "{edges: \"1\", gap: 0}", NULL, NULL);
+    CHECK(s_test_errors == 1, "second injection accepted while one runs");
+
+    test_run(100);
+    int accepted = -1, rejected = -1, dropped = -1, state = -1;
+    long long latency = -1;
+    CHECK(s_test_responses == 1, "%d answers", s_test_responses);
+    sscanf(s_test_response, "{accepted:%d,rejected:%d,dropped:%d,state:%d,latency_us:%lld}",
+           &accepted, &rejected, &dropped, &state, &latency);
+    // 1 at 0 ms, 0 at 20 ms bounces, 1 at 40 ms is no change, the pin read at the
+    // end of the window is low and 0 at 60 ms is no change again
+    CHECK(accepted == 2 && rejected == 1 && dropped == 0 && state == 0,
+          "accepted %d rejected %d dropped %d state %d", accepted, rejected, dropped, state);
+    CHECK(latency >= 0, "latency %lld us", latency);
+    CHECK(s_test_toggles == toggles + 2, "%d toggles", s_test_toggles - toggles);
+    CHECK(node_pir_get_last_edge_time() > start + TEST_DEBOUNCE_MS * 1000 &&
+          node_pir_get_last_edge_time() <= start + 60000, "last edge %lld us after the start",
+          (long long) (node_pir_get_last_edge_time() - start));
+
+    // Spaced wider than the window every edge counts
+    test_run(TEST_DEBOUNCE_MS);
+    toggles = s_test_toggles;
+    node_pir_rpc_inject_handler(NULL, "{edges: \"101\", gap: 80}", NULL, NULL);
+    test_run(200);
+    CHECK(s_test_responses == 2 && node_pir_get_state() == 1 && s_test_toggles == toggles + 3,
+          "%d toggles for three spaced edges", s_test_toggles - toggles);
+    node_pir_rpc_inject_handler(NULL, "{edges: \"10x\", gap: -1}", NULL, NULL);
+    CHECK(s_test_errors == 2, "negative gap accepted");
+}
+
+int main() {
+    test_isr_debounce();
+    test_inject();
+    return test_result("pir");
+}
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2018 Novutek S.C.
+# All rights reserved
+#
+# Licensed under the Apache License, Version 2.0 (the ""License"");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an ""AS IS"" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Builds the device filesystem (fs/) from the web UI sources (web/).
+#
+# Shared CSS/JS are bundled and named after their content hash, pages are
+# rewritten to point to those names, text assets are minified and stored
+# gzip compressed only. The firmware serves *.gz with Content-Encoding gzip
+# (see src/nvk_web.c). Only files it wrote before are replaced, data files
+# placed in fs/ (effect.fx, animations, matrix.json, palettes.json...) stay.
+# Run it after editing web/ and before mos build:
+#
+#     python3 tools/build_web.py
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SRC = os.path.join(ROOT, "web")
+OUT = os.path.join(ROOT, "fs")
+
+# Output name: sources concatenated in order. Pages keep linking the output name
+BUNDLES = {
+    "style.css": ["style.css"],
+    "script.js": ["script.js"],
+}
+
+TEXT = (".html", ".css", ".js")
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};,>])\s*", r"\1", text)
+    # Space before ':' is kept, it is a descendant selector there
+    text = re.sub(r":\s+", ":", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_js(text):
+    # Line based only, keeps newlines so automatic semicolons still work
+    lines = (line.strip() for line in text.splitlines())
+    return "\n".join(line for line in lines if line and not line.startswith("//"))
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    return minify_js(text)
+
+
+MINIFY = {".css": minify_css, ".js": minify_js, ".html": minify_html}
+
+
+def read(name):
+    with open(os.path.join(SRC, name), encoding="utf-8") as f:
+        return f.read()
+
+
+def write(name, data):
+    if name.endswith(TEXT):
+        with open(os.path.join(OUT, name + ".gz"), "wb") as f:
+            # No timestamp so unchanged sources give identical images
+            with gzip.GzipFile(filename="", mode="wb", fileobj=f, compresslevel=9, mtime=0) as gz:
+                gz.write(data)
+    else:
+        with open(os.path.join(OUT, name), "wb") as f:
+            f.write(data)
+
+
+def clean():
+    """Removes the outputs of a previous run: compressed assets and copied files"""
+    if not os.path.isdir(OUT):
+        os.makedirs(OUT)
+        return
+    copied = set(os.listdir(SRC))
+    for name in os.listdir(OUT):
+        if name.endswith(".gz") or name in copied:
+            os.remove(os.path.join(OUT, name))
+
+
+def main():
+    clean()
+
+    renames = {}
+    bundled = set()
+    for out, sources in BUNDLES.items():
+        base, ext = os.path.splitext(out)
+        text = MINIFY[ext]("\n".join(read(s) for s in sources)).encode("utf-8")
+        name = "%s.%s%s" % (base, hashlib.sha1(text).hexdigest()[:8], ext)
+        renames[out] = name
+        bundled.update(sources)
+        write(name, text)
+
+    raw = total = 0
+    for name in sorted(os.listdir(SRC)):
+        path = os.path.join(SRC, name)
+        raw += os.path.getsize(path)
+        if name in bundled:
+            continue
+        ext = os.path.splitext(name)[1]
+        if ext == ".html":
+            text = read(name)
+            for old, new in renames.items():
+                text = re.sub(r'(href|src)="%s"' % re.escape(old), r'\1="%s"' % new, text)
+            write(name, MINIFY[ext](text).encode("utf-8"))
+        elif ext in MINIFY:
+            write(name, MINIFY[ext](read(name)).encode("utf-8"))
+        else:
+            shutil.copyfile(path, os.path.join(OUT, name))
+
+    for name in os.listdir(OUT):
+        total += os.path.getsize(os.path.join(OUT, name))
+    print("web: %d bytes -> fs: %d bytes" % (raw, total))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2018 Novutek S.C.
+# All rights reserved
+#
+# Licensed under the Apache License, Version 2.0 (the ""License"");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an ""AS IS"" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Encodes raw RGB frames into the NVK animation format played by effect 17
+# (layout in include/nvk_anim.h). The input is frames x pixels x r, g, b
+# back to back, for example from a video scaled to one row per frame:
+#
+#     ffmpeg -i in.gif -vf scale=60:1 -f rawvideo -pix_fmt rgb24 anim.rgb
+#     python3 tools/make_anim.py --pixels 60 --frame-ms 40 --loop anim.rgb fs/anim.bin
+#
+# Every --keyframe frame is stored whole and listed in the index so seeking
+# decodes at most that many frames, the ones in between only store the
+# pixels that changed.
+
+import argparse
+import struct
+import sys
+
+VERSION = 1
+FLAG_LOOP = 0x01
+HEADER = struct.Struct("<4sBBHHHHH")
+INDEX = struct.Struct("<II")
+
+OP_SKIP = 0x00
+OP_RUN = 0x40
+OP_LITERAL = 0x80
+OP_END = 0xC0
+OP_MAX = 64
+
+
+def encode_span(pixels):
+    """RUN for two or more equal pixels, LITERAL for the rest"""
+    out = bytearray()
+    i = 0
+    while i < len(pixels):
+        run = 1
+        while i + run < len(pixels) and run < OP_MAX and pixels[i + run] == pixels[i]:
+            run += 1
+        if run >= 2:
+            out.append(OP_RUN | (run - 1))
+            out += pixels[i]
+            i += run
+            continue
+        start = i
+        i += 1
+        while i < len(pixels) and i - start < OP_MAX and (i + 1 == len(pixels) or pixels[i + 1] != pixels[i]):
+            i += 1
+        out.append(OP_LITERAL | (i - start - 1))
+        for p in pixels[start:i]:
+            out += p
+    return out
+
+
+def encode_frame(frame, previous):
+    if previous is None:
+        return b"K" + encode_span(frame) + bytes([OP_END])
+    out = bytearray(b"D")
+    i = 0
+    while i < len(frame):
+        start = i
+        while i < len(frame) and frame[i] == previous[i]:
+            i += 1
+        for skip in range(i - start, 0, -OP_MAX):
+            out.append(OP_SKIP | (min(skip, OP_MAX) - 1))
+        start = i
+        while i < len(frame) and frame[i] != previous[i]:
+            i += 1
+        out += encode_span(frame[start:i])
+    out.append(OP_END)
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Encode raw RGB frames into an NVK animation")
+    parser.add_argument("--pixels", type=int, required=True, help="pixels per frame")
+    parser.add_argument("--frame-ms", type=int, default=40, help="frame period")
+    parser.add_argument("--keyframe", type=int, default=30, help="frames between keyframes")
+    parser.add_argument("--loop", action="store_true", help="restart at the end")
+    parser.add_argument("input", help="raw r, g, b frames")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        raw = f.read()
+    size = args.pixels * 3
+    if args.pixels <= 0 or len(raw) == 0 or len(raw) % size != 0:
+        sys.exit("%s is not a whole number of %d pixel frames" % (args.input, args.pixels))
+    frames = [[raw[o + p * 3:o + p * 3 + 3] for p in range(args.pixels)] for o in range(0, len(raw), size)]
+    if len(frames) > 0xFFFF or args.pixels > 0xFFFF:
+        sys.exit("Too many frames or pixels for the format")
+
+    every = max(args.keyframe, 1)
+    keyframes = (len(frames) + every - 1) // every
+    data = bytearray()
+    index = []
+    offset = HEADER.size + INDEX.size * keyframes
+    for n, frame in enumerate(frames):
+        key = n % every == 0
+        if key:
+            index.append((n, offset + len(data)))
+        data += encode_frame(frame, None if key else frames[n - 1])
+
+    with open(args.output, "wb") as f:
+        f.write(HEADER.pack(b"NVKA", VERSION, FLAG_LOOP if args.loop else 0, args.pixels,
+                            len(frames), args.frame_ms, keyframes, 0))
+        for entry in index:
+            f.write(INDEX.pack(*entry))
+        f.write(data)
+    print("%s: %d frames, %d keyframes, %d bytes (%d raw)" %
+          (args.output, len(frames), keyframes, offset + len(data), len(raw)))
+
+
+if __name__ == "__main__":
+    main()
@@ -67,6 +67,21 @@ function getJson(url, cb, msg) {
     xhttp.send();
 }
 
+// Live state pushed by the device, cb gets only the fields that changed
+function liveState(cb, onopen, onclose) {
+    let ws = new WebSocket("ws://" + window.location.host + "/live");
+    ws.onopen = onopen || null;
+    ws.onmessage = function(ev) {
+        cb(JSON.parse(ev.data));
+    };
+    ws.onclose = function(ev) {
+        if (onclose) {
+            onclose(ev);
+        }
+    };
+    return ws;
+}
+
 function postJson(url, data, cb, msg) {
     let xhttp = new XMLHttpRequest();
     xhttp.open("POST", url, true);